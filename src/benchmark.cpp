@@ -104,6 +104,7 @@ const vector<string> Defaults = {
 /// bench 64 4 5000 current movetime -> search current position with 4 threads for 5 sec
 /// bench 64 1 100000 default nodes -> search default positions for 100K nodes each
 /// bench 16 1 5 default perft -> run a perft 5 on default positions
+/// bench 16 1 13 default depth mixed json -> as bench, with a JSON report on stderr
 
 vector<string> setup_bench(const Position& current, istream& is) {
 
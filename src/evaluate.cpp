@@ -67,6 +67,7 @@ namespace Eval {
   /// network may be embedded in the binary), in the active working directory and
   /// in the engine directory. Distro packagers may define the DEFAULT_NNUE_DIRECTORY
   /// variable to have the engine search in a special directory in their distro.
+  /// Network files in native layout are mapped in memory rather than read.
 
   void NNUE::init() {
 
@@ -90,7 +91,8 @@ namespace Eval {
             if (directory != "<internal>")
             {
                 ifstream stream(directory + eval_file, ios::binary);
-                if (load_eval(eval_file, stream))
+                if (   map_eval(eval_file, directory + eval_file)
+                    || load_eval(eval_file, stream))
                     eval_file_loaded = eval_file;
             }
 
@@ -109,6 +111,8 @@ namespace Eval {
                     eval_file_loaded = eval_file;
             }
         }
+
+    replicate();
   }
 
   /// NNUE::verify() verifies that the last net used was loaded successfully
@@ -1014,12 +1018,18 @@ Value Eval::evaluate(const Position& pos) {
 
   Value v;
 
+  Thread* th = pos.this_thread();
+
   if (!Eval::useNNUE)
+  {
+      th->count(Search::SearchStats::ClassicalEval);
       v = Evaluation<NO_TRACE>(pos).value();
+  }
   else
   {
       // Scale and shift NNUE for compatibility with search and classical evaluation
       auto  adjusted_NNUE = [&](){
+         th->count(Search::SearchStats::NnueEval);
          int mat = pos.non_pawn_material() + PieceValue[MG][PAWN] * pos.count<PAWN>();
          return NNUE::evaluate(pos) * (720 + mat / 32) / 1024 + Tempo;
       };
@@ -1030,6 +1040,9 @@ Value Eval::evaluate(const Position& pos) {
       bool  largePsq = psq * 16 > (NNUEThreshold1 + pos.non_pawn_material() / 64) * r50;
       bool  classical = largePsq || (psq > PawnValueMg / 4 && !(pos.this_thread()->nodes & 0xB));
 
+      if (classical)
+          th->count(Search::SearchStats::ClassicalEval);
+
       v = classical ? Evaluation<NO_TRACE>(pos).value() : adjusted_NNUE();
 
       // If the classical eval is small and imbalance large, use NNUE nevertheless.
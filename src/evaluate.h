@@ -41,9 +41,14 @@ namespace Eval {
   namespace NNUE {
 
     Value evaluate(const Position& pos);
+    void evaluate_batch(const Position* const* pos, size_t count, Value* values);
     bool load_eval(std::string name, std::istream& stream);
+    bool map_eval(std::string name, const std::string& path);
+    bool convert_eval(std::istream& in, std::ostream& out);
+    const char* native_layout();
     void init();
     void verify();
+    void replicate();
 
   } // namespace NNUE
 
@@ -62,7 +62,7 @@ struct Entry {
   Phase gamePhase;
 };
 
-typedef HashTable<Entry, 8192> Table;
+typedef HashTable<Entry> Table;
 
 Entry* probe(const Position& pos);
 
@@ -39,16 +39,29 @@ typedef bool(*fun3_t)(HANDLE, CONST GROUP_AFFINITY*, PGROUP_AFFINITY);
 }
 #endif
 
+#include <algorithm>
+#include <atomic>
+#include <climits>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <sstream>
 #include <vector>
 #include <cstdlib>
 
 #if defined(__linux__) && !defined(__ANDROID__)
+#include <sched.h>
+#include <set>
 #include <stdlib.h>
+#endif
+
+#if !defined(_WIN32)
+#include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #endif
 
 #if defined(__APPLE__) || defined(__ANDROID__) || defined(__OpenBSD__) || (defined(__GLIBCXX__) && !defined(_GLIBCXX_HAVE_ALIGNED_ALLOC) && !defined(_WIN32))
@@ -263,22 +276,169 @@ const std::string compiler_info() {
 }
 
 
-/// Debug functions used mainly to collect run-time statistics
-static std::atomic<int64_t> hits[2], means[2];
+/// Debug functions used mainly to collect run-time statistics. Each call site
+/// names its counter with a string literal, for instance dbg_hit_on(ttHit, "TT"),
+/// so that many counters can be used at the same time. Every thread counts in
+/// its own shard, without any shared cache line or atomic read-modify-write
+/// on the hot path, and the shards are merged by name only in dbg_print().
+
+namespace {
+
+  constexpr int DbgSlotNb = 32;
+  constexpr int DbgBucketNb = 16; // Histogram of log2 of the mean values
+
+  // A slot is written only by its owner thread. Values are atomic just to
+  // be read safely by dbg_print(), and are updated with plain loads and stores.
+  struct DbgSlot {
+    std::atomic<const char*> name;
+    bool mean;
+    std::atomic<int64_t> total, sum, min, max, buckets[DbgBucketNb];
+  };
+
+  struct DbgTotals {
+    int64_t total = 0, sum = 0, min = LLONG_MAX, max = LLONG_MIN, buckets[DbgBucketNb] = {};
+  };
+
+  typedef std::map<std::pair<std::string, bool>, DbgTotals> DbgMap;
+
+  struct DbgShard;
+  std::mutex dbgMutex;
+  std::vector<DbgShard*> dbgShards;
+  DbgMap dbgRetired; // Counts of the threads that have exited
+
+  void add(std::atomic<int64_t>& a, int64_t v) {
+    a.store(a.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+  }
+
+  int dbg_bucket(int64_t v) {
+    int b = 0;
+    for ( ; v > 0 && b < DbgBucketNb - 1; v >>= 1)
+        ++b;
+    return b;
+  }
+
+  struct DbgShard {
+
+    DbgShard() {
+      std::lock_guard<std::mutex> lk(dbgMutex);
+      dbgShards.push_back(this);
+    }
+
+   ~DbgShard() {
+      std::lock_guard<std::mutex> lk(dbgMutex);
+      merge(dbgRetired);
+      dbgShards.erase(std::find(dbgShards.begin(), dbgShards.end(), this));
+    }
+
+    // slot() returns the slot of a call site, claiming a new one on the first
+    // call. String literals are compared by address, which is cheap and safe
+    // because equal names are merged again by dbg_print().
+    DbgSlot* slot(const char* name, bool mean) {
+
+      for (int i = 0; i < used; ++i)
+          if (slots[i].name.load(std::memory_order_relaxed) == name && slots[i].mean == mean)
+              return &slots[i];
+
+      if (used == DbgSlotNb)
+          return nullptr;
+
+      DbgSlot* s = &slots[used++];
+      s->mean = mean;
+      s->min = LLONG_MAX;
+      s->max = LLONG_MIN;
+      s->name.store(name, std::memory_order_release); // Publish to dbg_print()
+      return s;
+    }
+
+    void merge(DbgMap& m) const {
+
+      for (const DbgSlot& s : slots)
+      {
+          const char* name = s.name.load(std::memory_order_acquire);
+          if (!name)
+              break;
+
+          DbgTotals& t = m[{ name, s.mean }];
+          t.total += s.total;
+          t.sum   += s.sum;
+          t.min    = std::min(t.min, int64_t(s.min));
+          t.max    = std::max(t.max, int64_t(s.max));
+          for (int i = 0; i < DbgBucketNb; ++i)
+              t.buckets[i] += s.buckets[i];
+      }
+    }
+
+    DbgSlot slots[DbgSlotNb] = {};
+    int used = 0;
+  };
+
+  thread_local DbgShard dbgShard;
+
+} // namespace
+
+void dbg_hit_on(bool b, const char* name) {
+
+  if (DbgSlot* s = dbgShard.slot(name, false))
+  {
+      add(s->total, 1);
+      add(s->sum, b);
+  }
+}
 
-void dbg_hit_on(bool b) { ++hits[0]; if (b) ++hits[1]; }
 void dbg_hit_on(bool c, bool b) { if (c) dbg_hit_on(b); }
-void dbg_mean_of(int v) { ++means[0]; means[1] += v; }
+
+void dbg_mean_of(int64_t v, const char* name) {
+
+  if (DbgSlot* s = dbgShard.slot(name, true))
+  {
+      add(s->total, 1);
+      add(s->sum, v);
+      add(s->buckets[dbg_bucket(v)], 1);
+      if (v < s->min) s->min.store(v, std::memory_order_relaxed);
+      if (v > s->max) s->max.store(v, std::memory_order_relaxed);
+  }
+}
 
 void dbg_print() {
 
-  if (hits[0])
-      cerr << "Total " << hits[0] << " Hits " << hits[1]
-           << " hit rate (%) " << 100 * hits[1] / hits[0] << endl;
+  DbgMap m;
+
+  {
+      std::lock_guard<std::mutex> lk(dbgMutex);
+      m = dbgRetired;
+      for (const DbgShard* shard : dbgShards)
+          shard->merge(m);
+  }
+
+  for (const auto& [key, t] : m)
+  {
+      if (!t.total)
+          continue;
+
+      if (!key.second)
+      {
+          cerr << key.first << ": Total " << t.total << " Hits " << t.sum
+               << " hit rate (%) " << 100 * t.sum / t.total << endl;
+          continue;
+      }
 
-  if (means[0])
-      cerr << "Total " << means[0] << " Mean "
-           << (double)means[1] / means[0] << endl;
+      cerr << key.first << ": Total " << t.total << " Mean " << (double)t.sum / t.total
+           << " Min " << t.min << " Max " << t.max << endl;
+
+      // Bucket i > 0 holds the values in [2^(i-1), 2^i - 1], the last one is open
+      for (int i = 0; i < DbgBucketNb; ++i)
+          if (t.buckets[i])
+          {
+              cerr << "  ";
+              if (i <= 1)
+                  cerr << (i ? "1" : "<= 0");
+              else if (i == DbgBucketNb - 1)
+                  cerr << ">= " << (1LL << (i - 1));
+              else
+                  cerr << (1LL << (i - 1)) << "-" << (1LL << i) - 1;
+              cerr << ": " << t.buckets[i] << endl;
+          }
+  }
 }
 
 
@@ -464,12 +624,318 @@ void aligned_large_pages_free(void *mem) {
 #endif
 
 
+/// map_file() maps a whole file read-only in memory, so that it is shared with
+/// the page cache and with other processes mapping the same file. The mapping
+/// is hinted to use large pages and to be read ahead. Returns nullptr on failure.
+
+#if defined(_WIN32)
+
+void* map_file(const std::string& fname, size_t* size) {
+
+  HANDLE file = CreateFileA(fname.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+      return nullptr;
+
+  LARGE_INTEGER fileSize;
+  HANDLE mapping = nullptr;
+  void* mem = nullptr;
+
+  if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+      mapping = CreateFileMapping(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+  if (mapping)
+  {
+      mem = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+      CloseHandle(mapping); // The view keeps the mapping alive
+  }
+
+  CloseHandle(file);
+  *size = size_t(fileSize.QuadPart);
+  return mem;
+}
+
+void unmap_file(void* mem, size_t) {
+  UnmapViewOfFile(mem);
+}
+
+#else
+
+void* map_file(const std::string& fname, size_t* size) {
+
+  int fd = ::open(fname.c_str(), O_RDONLY);
+  if (fd == -1)
+      return nullptr;
+
+  struct stat statbuf;
+  void* mem = nullptr;
+
+  if (fstat(fd, &statbuf) == 0 && statbuf.st_size > 0)
+  {
+      *size = size_t(statbuf.st_size);
+      mem = mmap(nullptr, *size, PROT_READ, MAP_SHARED, fd, 0);
+      if (mem == MAP_FAILED)
+          mem = nullptr;
+  }
+
+  ::close(fd); // The mapping keeps the file open
+
+  if (mem)
+  {
+#if defined(MADV_HUGEPAGE)
+      madvise(mem, *size, MADV_HUGEPAGE);
+#endif
+#if defined(MADV_WILLNEED)
+      madvise(mem, *size, MADV_WILLNEED);
+#endif
+  }
+
+  return mem;
+}
+
+void unmap_file(void* mem, size_t size) {
+  munmap(mem, size);
+}
+
+#endif
+
+
+/// pin_cpus() restricts the calling thread, and the threads it creates from
+/// now on, to the first n processors it is allowed to run on. With n == 0 the
+/// affinity before the first call is restored. Returns false if thread
+/// affinity is not supported, which is the case everywhere but on Linux.
+
+bool pin_cpus(size_t n) {
+
+#if defined(__linux__) && !defined(__ANDROID__)
+  static cpu_set_t saved;
+  static bool pinned = false;
+
+  if (!n)
+  {
+      if (pinned)
+          sched_setaffinity(0, sizeof(saved), &saved);
+      pinned = false;
+      return true;
+  }
+
+  if (!pinned && sched_getaffinity(0, sizeof(saved), &saved))
+      return false;
+
+  pinned = true;
+
+  cpu_set_t mask;
+  CPU_ZERO(&mask);
+
+  for (int c = 0; c < CPU_SETSIZE && n; ++c)
+      if (CPU_ISSET(c, &saved))
+          CPU_SET(c, &mask), --n;
+
+  return !sched_setaffinity(0, sizeof(mask), &mask);
+#else
+  (void)n;
+  return false;
+#endif
+}
+
+
 namespace WinProcGroup {
 
-#ifndef _WIN32
+#if defined(__linux__) && !defined(__ANDROID__)
+
+namespace {
+
+/// NumaNode keeps the logical processors of a NUMA node and the number of
+/// physical cores they belong to, as read from sysfs.
+
+struct NumaNode {
+  std::vector<int> cpus;
+  int cores;
+};
+
+/// StartupCpus is the affinity mask the engine was started with, e.g. by taskset
+/// or a cgroup. It defines the topology threads are spread over; the mask a
+/// thread is bound to is further restricted by bindThisThread().
+
+const cpu_set_t StartupCpus = [] {
+
+  cpu_set_t mask;
+
+  if (sched_getaffinity(0, sizeof(mask), &mask))
+      for (int c = 0; c < CPU_SETSIZE; ++c)
+          CPU_SET(c, &mask);
+
+  return mask;
+}();
+
+/// cpu_list() parses a list of processors in the kernel format, e.g. "0-3,8,10-11"
+
+std::vector<int> cpu_list(const std::string& fname) {
+
+  std::vector<int> cpus;
+  std::ifstream file(fname);
+  std::string range;
+
+  while (std::getline(file, range, ','))
+  {
+      int first, last;
+      char dash;
+      std::istringstream ss(range);
+
+      if (!(ss >> first))
+          continue;
+
+      last = (ss >> dash >> last) ? last : first;
+
+      for (int c = first; c <= last; ++c)
+          cpus.push_back(c);
+  }
+
+  return cpus;
+}
+
+/// numa_nodes() reads the NUMA topology once, keeping only the processors in
+/// StartupCpus. Nodes left without processors, e.g. memory only nodes or nodes
+/// outside the startup mask, are skipped.
+
+const std::vector<NumaNode>& numa_nodes() {
+
+  static const std::vector<NumaNode> nodes = [] {
+
+      std::vector<NumaNode> v;
+
+      for (int n : cpu_list("/sys/devices/system/node/online"))
+      {
+          NumaNode node;
+          std::set<std::string> siblings;
+
+          for (int c : cpu_list("/sys/devices/system/node/node" + std::to_string(n) + "/cpulist"))
+              if (c < CPU_SETSIZE && CPU_ISSET(c, &StartupCpus))
+                  node.cpus.push_back(c);
+
+          for (int c : node.cpus)
+          {
+              std::ifstream file("/sys/devices/system/cpu/cpu" + std::to_string(c) + "/topology/thread_siblings_list");
+              std::string s;
+              std::getline(file, s);
+              siblings.insert(s);
+          }
+
+          node.cores = int(siblings.size());
+
+          if (!node.cpus.empty())
+              v.push_back(node);
+      }
+
+      return v;
+  }();
+
+  return nodes;
+}
+
+/// best_node() returns the NUMA node for the thread with index idx, with the
+/// same policy used for Windows processor groups: fill the physical cores of
+/// one node before moving to the next, then spread hyperthreads evenly.
+
+int best_node(size_t idx) {
+
+  const std::vector<NumaNode>& nodes = numa_nodes();
+  std::vector<int> groups;
+  int cores = 0, threads = 0;
+
+  for (size_t n = 0; n < nodes.size(); ++n)
+  {
+      cores += nodes[n].cores;
+      threads += int(nodes[n].cpus.size());
+
+      for (int i = 0; i < nodes[n].cores; ++i)
+          groups.push_back(int(n));
+  }
+
+  for (int t = 0; t < threads - cores; t++)
+      groups.push_back(t % int(nodes.size()));
+
+  return idx < groups.size() ? groups[idx] : -1;
+}
+
+} // namespace
+
+
+/// bindThisThread() sets the affinity of the current thread to the processors
+/// of its NUMA node, so that memory it touches first is allocated on the same
+/// node. Only processors the thread is currently allowed to run on are kept,
+/// so that a later restriction, e.g. by pin_cpus(), is not overridden; if none
+/// of them is on the node the thread is left as it is. Nothing is done on
+/// machines with a single node.
+
+void bindThisThread(size_t idx) {
+
+  if (numa_nodes().size() < 2)
+      return;
+
+  int node = best_node(idx);
+
+  if (node == -1)
+      return;
+
+  cpu_set_t allowed, mask;
+  CPU_ZERO(&mask);
+
+  if (sched_getaffinity(0, sizeof(allowed), &allowed))
+      return;
+
+  for (int c : numa_nodes()[node].cpus)
+      if (CPU_ISSET(c, &allowed))
+          CPU_SET(c, &mask);
+
+  if (CPU_COUNT(&mask))
+      sched_setaffinity(0, sizeof(mask), &mask);
+}
+
+
+/// node() returns the NUMA node bindThisThread() uses for the thread with
+/// index idx, or -1 if the thread is not bound.
+
+int node(size_t idx) {
+
+  return numa_nodes().size() < 2 ? -1 : best_node(idx);
+}
+
+
+/// topology() describes the nodes found and how the given number of threads
+/// is spread over them. Returns an empty string if no binding is done.
+
+std::string topology(size_t threads) {
+
+  const std::vector<NumaNode>& nodes = numa_nodes();
+
+  if (nodes.size() < 2)
+      return "";
+
+  std::vector<size_t> bound(nodes.size());
+  std::stringstream ss;
+
+  for (size_t idx = 0; idx < threads; ++idx)
+      if (best_node(idx) != -1)
+          bound[best_node(idx)]++;
+
+  ss << "NUMA nodes " << nodes.size() << ", threads per node";
+
+  for (size_t n = 0; n < nodes.size(); ++n)
+      ss << (n ? " + " : " ") << bound[n]
+         << " (" << nodes[n].cores << " cores, " << nodes[n].cpus.size() << " cpus)";
+
+  return ss.str();
+}
+
+#elif !defined(_WIN32)
 
 void bindThisThread(size_t) {}
 
+int node(size_t) { return -1; }
+
+std::string topology(size_t) { return ""; }
+
 #else
 
 /// best_group() retrieves logical processor information using Windows specific
@@ -566,6 +1032,19 @@ void bindThisThread(size_t idx) {
       fun3(GetCurrentThread(), &affinity, nullptr);
 }
 
+
+/// node() returns the processor group bindThisThread() uses for the thread with
+/// index idx. This is not the NUMA node: a group may span several nodes and a
+/// node several groups. The group is still the unit threads are bound to here,
+/// so callers use it to place memory close to the threads of the group.
+
+int node(size_t idx) { return best_group(idx); }
+
+
+/// topology() is not implemented for Windows processor groups
+
+std::string topology(size_t) { return ""; }
+
 #endif
 
 } // namespace WinProcGroup
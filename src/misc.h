@@ -21,7 +21,9 @@
 
 #include <cassert>
 #include <chrono>
-#include <ostream>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
 #include <string>
 #include <vector>
 
@@ -35,10 +37,13 @@ void* std_aligned_alloc(size_t alignment, size_t size);
 void std_aligned_free(void* ptr);
 void* aligned_large_pages_alloc(size_t size); // memory aligned by page size, min alignment: 4096 bytes
 void aligned_large_pages_free(void* mem); // nop if mem == nullptr
+void* map_file(const std::string& fname, size_t* size); // read-only, nullptr on failure
+void unmap_file(void* mem, size_t size);
+bool pin_cpus(size_t n); // 0 restores the previous affinity
 
-void dbg_hit_on(bool b);
+void dbg_hit_on(bool b, const char* name = "Hit");
 void dbg_hit_on(bool c, bool b);
-void dbg_mean_of(int v);
+void dbg_mean_of(int64_t v, const char* name = "Mean");
 void dbg_print();
 
 typedef std::chrono::milliseconds::rep TimePoint; // A value in milliseconds
@@ -48,12 +53,39 @@ inline TimePoint now() {
         (std::chrono::steady_clock::now().time_since_epoch()).count();
 }
 
-template<class Entry, int Size>
+/// HashTable is a table of Entry indexed by the lower bits of a key. Its size
+/// is set at runtime with resize(), rounded down to a power of two entries.
+template<class Entry>
 struct HashTable {
-  Entry* operator[](Key key) { return &table[(uint32_t)key & (Size - 1)]; }
+
+  HashTable() = default;
+  HashTable(const HashTable&) = delete;
+  HashTable& operator=(const HashTable&) = delete;
+ ~HashTable() { aligned_large_pages_free(table); }
+
+  Entry* operator[](Key key) { return &table[(uint32_t)key & mask]; }
+
+  void resize(size_t kbSize) {
+
+    size_t count = 1;
+    while (2 * count * sizeof(Entry) <= kbSize * 1024)
+        count *= 2;
+
+    aligned_large_pages_free(table);
+    table = static_cast<Entry*>(aligned_large_pages_alloc(count * sizeof(Entry)));
+    if (!table)
+    {
+        std::cerr << "Failed to allocate " << kbSize << "KB for a hash table." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    std::memset(static_cast<void*>(table), 0, count * sizeof(Entry));
+    mask = count - 1;
+  }
 
 private:
-  std::vector<Entry> table = std::vector<Entry>(Size); // Allocate on the heap
+  Entry* table = nullptr;
+  size_t mask = 0;
 };
 
 
@@ -118,10 +150,13 @@ inline uint64_t mul_hi64(uint64_t a, uint64_t b) {
 /// logical processor group. This usually means to be limited to use max 64
 /// cores. To overcome this, some special platform specific API should be
 /// called to set group affinity for each thread. Original code from Texel by
-/// Peter Österlund.
+/// Peter Österlund. Under Linux the same placement is done by binding each
+/// thread to the processors of a NUMA node, read from sysfs.
 
 namespace WinProcGroup {
   void bindThisThread(size_t idx);
+  int node(size_t idx); // NUMA node under Linux, processor group under Windows
+  std::string topology(size_t threads);
 }
 
 namespace CommandLine {
@@ -207,6 +207,23 @@ namespace {
   }
 
 
+  template<Color Us, GenType Type>
+  ExtMove* generate_king_moves(const Position& pos, ExtMove* moveList, Bitboard target) {
+
+    Square ksq = pos.square<KING>(Us);
+    Bitboard b = attacks_bb<KING>(ksq) & target;
+    while (b)
+        *moveList++ = make_move(ksq, pop_lsb(&b));
+
+    if ((Type != CAPTURES) && pos.can_castle(Us & ANY_CASTLING))
+        for (CastlingRights cr : { Us & KING_SIDE, Us & QUEEN_SIDE } )
+            if (!pos.castling_impeded(cr) && pos.can_castle(cr))
+                *moveList++ = make<CASTLING>(ksq, pos.castling_rook_square(cr));
+
+    return moveList;
+  }
+
+
   template<Color Us, GenType Type>
   ExtMove* generate_all(const Position& pos, ExtMove* moveList) {
     constexpr bool Checks = Type == QUIET_CHECKS; // Reduce template instantations
@@ -241,19 +258,111 @@ namespace {
     moveList = generate_moves<Us,  QUEEN, Checks>(pos, moveList, target);
 
     if (Type != QUIET_CHECKS && Type != EVASIONS)
+        moveList = generate_king_moves<Us, Type>(pos, moveList, target);
+
+    return moveList;
+  }
+
+
+  template<Color Us>
+  ExtMove* generate_quiets(const Position& pos, ExtMove* moveList, PieceType pt) {
+
+    const Bitboard target = ~pos.pieces();
+
+    switch (pt)
     {
-        Square ksq = pos.square<KING>(Us);
-        Bitboard b = attacks_bb<KING>(ksq) & target;
+    case PAWN:   return generate_pawn_moves<Us, QUIETS>(pos, moveList, target);
+    case KNIGHT: return generate_moves<Us, KNIGHT, false>(pos, moveList, target);
+    case BISHOP: return generate_moves<Us, BISHOP, false>(pos, moveList, target);
+    case ROOK:   return generate_moves<Us,   ROOK, false>(pos, moveList, target);
+    case QUEEN:  return generate_moves<Us,  QUEEN, false>(pos, moveList, target);
+    default:     return generate_king_moves<Us, QUIETS>(pos, moveList, target);
+    }
+  }
+
+
+  template<Color Us>
+  size_t count_legal(const Position& pos) {
+
+    constexpr Color     Them     = ~Us;
+    constexpr Bitboard  TRank8BB = (Us == WHITE ? Rank8BB    : Rank1BB);
+    constexpr Bitboard  TRank3BB = (Us == WHITE ? Rank3BB    : Rank6BB);
+    constexpr Direction Up       = pawn_push(Us);
+    constexpr Direction UpRight  = (Us == WHITE ? NORTH_EAST : SOUTH_WEST);
+    constexpr Direction UpLeft   = (Us == WHITE ? NORTH_WEST : SOUTH_EAST);
+
+    const Square ksq = pos.square<KING>(Us);
+    const Bitboard pinned = pos.blockers_for_king(Us) & pos.pieces(Us);
+    size_t cnt = 0;
+
+    // King moves, checked against the attackers of the destination square as
+    // if the king had already left its square.
+    Bitboard b = attacks_bb<KING>(ksq) & ~pos.pieces(Us);
+    while (b)
+        if (!(pos.attackers_to(pop_lsb(&b), pos.pieces() ^ ksq) & pos.pieces(Them)))
+            ++cnt;
+
+    if (more_than_one(pos.checkers()))
+        return cnt; // Double check, only a king move can save the day
+
+    // Other moves must block or capture the checking piece, if any, and pinned
+    // pieces can only move along the line of their pinner.
+    Bitboard target = pos.checkers() ? between_bb(ksq, lsb(pos.checkers())) | pos.checkers()
+                                     : ~pos.pieces(Us);
+
+    for (PieceType pt : { KNIGHT, BISHOP, ROOK, QUEEN })
+    {
+        b = pos.pieces(Us, pt);
         while (b)
-            *moveList++ = make_move(ksq, pop_lsb(&b));
+        {
+            Square from = pop_lsb(&b);
+            Bitboard att = attacks_bb(pt, from, pos.pieces()) & target;
+            cnt += popcount(pinned & from ? att & line_bb(ksq, from) : att);
+        }
+    }
+
+    // Pawn moves, counting four moves for each promotion. Unpinned pawns are
+    // handled all at once and pinned ones one by one.
+    auto pawn_moves = [&](Bitboard pawns, Bitboard mask) {
+        Bitboard b1 = shift<Up>(pawns) & ~pos.pieces();
+        Bitboard b2 = shift<Up>(b1 & TRank3BB) & ~pos.pieces();
+        Bitboard b3 = shift<UpRight>(pawns) & pos.pieces(Them);
+        Bitboard b4 = shift<UpLeft >(pawns) & pos.pieces(Them);
+        b1 &= mask, b2 &= mask, b3 &= mask, b4 &= mask;
+
+        return  popcount(b1 & ~TRank8BB) + 4 * popcount(b1 & TRank8BB)
+              + popcount(b2)
+              + popcount(b3 & ~TRank8BB) + 4 * popcount(b3 & TRank8BB)
+              + popcount(b4 & ~TRank8BB) + 4 * popcount(b4 & TRank8BB);
+    };
+
+    cnt += pawn_moves(pos.pieces(Us, PAWN) & ~pinned, target);
+
+    b = pos.pieces(Us, PAWN) & pinned;
+    while (b)
+    {
+        Square from = pop_lsb(&b);
+        cnt += pawn_moves(square_bb(from), target & line_bb(ksq, from));
+    }
 
-        if ((Type != CAPTURES) && pos.can_castle(Us & ANY_CASTLING))
-            for (CastlingRights cr : { Us & KING_SIDE, Us & QUEEN_SIDE } )
-                if (!pos.castling_impeded(cr) && pos.can_castle(cr))
-                    *moveList++ = make<CASTLING>(ksq, pos.castling_rook_square(cr));
+    // En passant captures may expose the king along the rank of the two pawns,
+    // and can be an evasion only if the double pushed pawn is the checker.
+    if (   pos.ep_square() != SQ_NONE
+        && (!pos.checkers() || (target & (pos.ep_square() - Up))))
+    {
+        b = pos.pieces(Us, PAWN) & pawn_attacks_bb(Them, pos.ep_square());
+        while (b)
+            if (pos.legal(make<ENPASSANT>(pop_lsb(&b), pos.ep_square())))
+                ++cnt;
     }
 
-    return moveList;
+    if (!pos.checkers() && pos.can_castle(Us & ANY_CASTLING))
+        for (CastlingRights cr : { Us & KING_SIDE, Us & QUEEN_SIDE } )
+            if (   !pos.castling_impeded(cr) && pos.can_castle(cr)
+                && pos.legal(make<CASTLING>(ksq, pos.castling_rook_square(cr))))
+                ++cnt;
+
+    return cnt;
   }
 
 } // namespace
@@ -283,6 +392,19 @@ template ExtMove* generate<QUIETS>(const Position&, ExtMove*);
 template ExtMove* generate<NON_EVASIONS>(const Position&, ExtMove*);
 
 
+/// generate_quiets() generates the pseudo-legal non-captures of the pieces of
+/// type pt of the side to move, castling moves included with the king ones.
+/// Together, the lists of all the piece types hold the moves of generate<QUIETS>.
+
+ExtMove* generate_quiets(const Position& pos, ExtMove* moveList, PieceType pt) {
+
+  assert(!pos.checkers());
+
+  return pos.side_to_move() == WHITE ? generate_quiets<WHITE>(pos, moveList, pt)
+                                     : generate_quiets<BLACK>(pos, moveList, pt);
+}
+
+
 /// generate<QUIET_CHECKS> generates all pseudo-legal non-captures.
 /// Returns a pointer to the end of the move list.
 template<>
@@ -365,3 +487,18 @@ ExtMove* generate<LEGAL>(const Position& pos, ExtMove* moveList) {
 
   return moveList;
 }
+
+
+/// legal_move_count() returns the number of legal moves in the given position,
+/// which is MoveList<LEGAL>(pos).size(), but computed from the bitboards alone
+/// without generating the moves. Used by perft at the last ply.
+
+size_t legal_move_count(const Position& pos) {
+
+  size_t cnt = pos.side_to_move() == WHITE ? count_legal<WHITE>(pos)
+                                           : count_legal<BLACK>(pos);
+
+  assert(cnt == MoveList<LEGAL>(pos).size());
+
+  return cnt;
+}
@@ -53,6 +53,9 @@ inline bool operator<(const ExtMove& f, const ExtMove& s) {
 template<GenType>
 ExtMove* generate(const Position& pos, ExtMove* moveList);
 
+ExtMove* generate_quiets(const Position& pos, ExtMove* moveList, PieceType pt);
+size_t legal_move_count(const Position& pos);
+
 /// The MoveList struct is a simple wrapper around generate(). It sometimes comes
 /// in handy to use this class instead of the low level generate() function.
 template<GenType T>
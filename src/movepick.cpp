@@ -18,7 +18,12 @@
 
 #include <cassert>
 
+#if defined(USE_AVX2)
+#include <immintrin.h>
+#endif
+
 #include "movepick.h"
+#include "thread.h"
 
 namespace {
 
@@ -29,19 +34,104 @@ namespace {
     QSEARCH_TT, QCAPTURE_INIT, QCAPTURE, QCHECK_INIT, QCHECK
   };
 
+#if defined(USE_AVX2)
+
+  static_assert(sizeof(ExtMove) == 8 && sizeof(Piece) == 4, "Unexpected layout for SIMD scoring");
+
+  // load_field() gathers the moves (Field == 0) or the values (Field == 1)
+  // of 8 consecutive ExtMove into the 32 bit lanes of a vector.
+  template<int Field>
+  __m256i load_field(const ExtMove* m) {
+
+    const __m256i sel = _mm256_setr_epi32(Field, Field + 2, Field + 4, Field + 6,
+                                          Field, Field + 2, Field + 4, Field + 6);
+    __m256i lo = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i*)m), sel);
+    __m256i hi = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i*)(m + 4)), sel);
+    return _mm256_blend_epi32(lo, hi, 0xF0);
+  }
+
+  // store_values() writes the 8 lanes of v to the values of 8 consecutive ExtMove
+  void store_values(ExtMove* m, __m256i v) {
+
+    __m256i* p = (__m256i*)m;
+    __m256i lo = _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3));
+    __m256i hi = _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7));
+    _mm256_storeu_si256(p,     _mm256_blend_epi32(_mm256_loadu_si256(p),     lo, 0xAA));
+    _mm256_storeu_si256(p + 1, _mm256_blend_epi32(_mm256_loadu_si256(p + 1), hi, 0xAA));
+  }
+
+  // gather16() loads and sign extends the int16_t history entries at the given
+  // indices. Indices are never zero (a move's from and to squares differ, and
+  // a moved piece is never NO_PIECE), so we load 32 bits starting one entry
+  // earlier and keep the upper half, without reading past the table end.
+  __m256i gather16(const void* table, __m256i idx) {
+
+    idx = _mm256_sub_epi32(idx, _mm256_set1_epi32(1));
+    return _mm256_srai_epi32(_mm256_i32gather_epi32((const int*)table, idx, 2), 16);
+  }
+
+#endif
+
+#if defined(USE_LAZY_QUIETS)
+
+  // Quiet moves are generated in batches of piece types, minor pieces first,
+  // and a batch is generated only when the previous ones have been searched
+  // without a cutoff. Each batch is sorted on its own, so this changes the
+  // move order and is only enabled with 'make lazyquiets=yes'.
+  constexpr PieceType QuietBatches[][2] = {
+    { KNIGHT, BISHOP }, { ROOK, QUEEN }, { PAWN, NO_PIECE_TYPE }, { KING, NO_PIECE_TYPE }
+  };
+  constexpr int QuietBatchNb = sizeof(QuietBatches) / sizeof(QuietBatches[0]);
+
+#endif
+
+  // tt_move_ok() checks that the TT move is pseudo legal. A TT move that is not
+  // proves that the TT entry belongs to another position (key collision) or has
+  // been torn by a concurrent write. Count these false hits for 'ttstats'.
+  bool tt_move_ok(const Position& pos, Move ttm) {
+
+    if (!ttm)
+        return false;
+
+    if (pos.pseudo_legal(ttm))
+        return true;
+
+    pos.this_thread()->ttCollisions.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
   // partial_insertion_sort() sorts moves in descending order up to and including
   // a given limit. The order of moves smaller than the limit is left unspecified.
   void partial_insertion_sort(ExtMove* begin, ExtMove* end, int limit) {
 
-    for (ExtMove *sortedEnd = begin, *p = begin + 1; p < end; ++p)
+    ExtMove *sortedEnd = begin, *p = begin + 1;
+
+    auto insert = [&](ExtMove* m) {
+        ExtMove tmp = *m, *q;
+        *m = *++sortedEnd;
+        for (q = sortedEnd; q != begin && *(q - 1) < tmp; --q)
+            *q = *(q - 1);
+        *q = tmp;
+    };
+
+#if defined(USE_AVX2)
+    // Compare 8 values at a time and insert only the moves above the limit.
+    // Inserting a move only writes at or before its own position, so the
+    // mask of a block remains valid while the block is processed.
+    const __m256i lim = _mm256_set1_epi32(limit - 1);
+
+    for ( ; p + 8 <= end; p += 8)
+    {
+        Bitboard b = _mm256_movemask_ps(_mm256_castsi256_ps(
+                         _mm256_cmpgt_epi32(load_field<1>(p), lim)));
+        while (b)
+            insert(p + pop_lsb(&b));
+    }
+#endif
+
+    for ( ; p < end; ++p)
         if (p->value >= limit)
-        {
-            ExtMove tmp = *p, *q;
-            *p = *++sortedEnd;
-            for (q = sortedEnd; q != begin && *(q - 1) < tmp; --q)
-                *q = *(q - 1);
-            *q = tmp;
-        }
+            insert(p);
   }
 
 } // namespace
@@ -61,8 +151,7 @@ MovePicker::MovePicker(const Position& p, Move ttm, Depth d, const ButterflyHist
 
   assert(d > 0);
 
-  stage = (pos.checkers() ? EVASION_TT : MAIN_TT) +
-          !(ttm && pos.pseudo_legal(ttm));
+  stage = (pos.checkers() ? EVASION_TT : MAIN_TT) + !tt_move_ok(pos, ttm);
 }
 
 /// MovePicker constructor for quiescence search
@@ -73,8 +162,7 @@ MovePicker::MovePicker(const Position& p, Move ttm, Depth d, const ButterflyHist
   assert(d <= 0);
 
   stage = (pos.checkers() ? EVASION_TT : QSEARCH_TT) +
-           !(ttm && (depth > DEPTH_QS_RECAPTURES || to_sq(ttm) == recaptureSquare)
-                 && pos.pseudo_legal(ttm));
+           !(tt_move_ok(pos, ttm) && (depth > DEPTH_QS_RECAPTURES || to_sq(ttm) == recaptureSquare));
 }
 
 /// MovePicker constructor for ProbCut: we generate captures with SEE greater
@@ -84,9 +172,8 @@ MovePicker::MovePicker(const Position& p, Move ttm, Value th, const CapturePiece
 
   assert(!pos.checkers());
 
-  stage = PROBCUT_TT + !(ttm && pos.capture(ttm)
-                             && pos.pseudo_legal(ttm)
-                             && pos.see_ge(ttm, threshold));
+  stage = PROBCUT_TT + !(tt_move_ok(pos, ttm) && pos.capture(ttm)
+                                              && pos.see_ge(ttm, threshold));
 }
 
 /// MovePicker::score() assigns a numerical value to each move in a list, used
@@ -97,7 +184,58 @@ void MovePicker::score() {
 
   static_assert(Type == CAPTURES || Type == QUIETS || Type == EVASIONS, "Wrong type");
 
-  for (auto& m : *this)
+  ExtMove* it = cur;
+
+#if defined(USE_AVX2)
+  // Score 8 moves at a time, gathering the same table entries as the scalar
+  // code below, which scores the remaining moves.
+  if (Type == CAPTURES || Type == QUIETS)
+  {
+      const int* board = (const int*)pos.board_data();
+      const __m256i sq = _mm256_set1_epi32(63);
+
+      for ( ; it + 8 <= endMoves; it += 8)
+      {
+          __m256i m    = load_field<0>(it);
+          __m256i to   = _mm256_and_si256(m, sq);
+          __m256i from = _mm256_and_si256(_mm256_srli_epi32(m, 6), sq);
+          __m256i pc   = _mm256_i32gather_epi32(board, from, 4);
+          __m256i pcTo = _mm256_or_si256(_mm256_slli_epi32(pc, 6), to);
+          __m256i v;
+
+          if (Type == CAPTURES)
+          {
+              __m256i captured = _mm256_i32gather_epi32(board, to, 4);
+              __m256i idx = _mm256_or_si256(_mm256_slli_epi32(pcTo, 3),
+                                            _mm256_and_si256(captured, _mm256_set1_epi32(7)));
+              v = _mm256_i32gather_epi32((const int*)PieceValue[MG], captured, 4);
+              v = _mm256_mullo_epi32(v, _mm256_set1_epi32(6));
+              v = _mm256_add_epi32(v, gather16(&(*captureHistory)[0][0][0], idx));
+          }
+          else
+          {
+              __m256i fromTo = _mm256_and_si256(m, _mm256_set1_epi32(0xFFF));
+              v =                   gather16(&(*continuationHistory[0])[0][0], pcTo);
+              v = _mm256_add_epi32(v, gather16(&(*continuationHistory[1])[0][0], pcTo));
+              v = _mm256_add_epi32(v, gather16(&(*continuationHistory[3])[0][0], pcTo));
+              v = _mm256_add_epi32(v, v);
+              v = _mm256_add_epi32(v, gather16(&(*continuationHistory[5])[0][0], pcTo));
+              v = _mm256_add_epi32(v, gather16(&(*mainHistory)[pos.side_to_move()][0], fromTo));
+
+              if (ply < MAX_LPH)
+                  v = _mm256_add_epi32(v, _mm256_mullo_epi32(_mm256_set1_epi32(std::min(4, depth / 3)),
+                                                             gather16(&(*lowPlyHistory)[ply][0], fromTo)));
+          }
+
+          store_values(it, v);
+      }
+  }
+#endif
+
+  for ( ; it < endMoves; ++it)
+  {
+      ExtMove& m = *it;
+
       if (Type == CAPTURES)
           m.value =  int(PieceValue[MG][pos.piece_on(to_sq(m))]) * 6
                    + (*captureHistory)[pos.moved_piece(m)][to_sq(m)][type_of(pos.piece_on(to_sq(m)))];
@@ -120,6 +258,13 @@ void MovePicker::score() {
                        + (*continuationHistory[0])[pos.moved_piece(m)][to_sq(m)]
                        - (1 << 28);
       }
+  }
+}
+
+/// MovePicker::count_generated() adds the moves just generated in [cur, endMoves)
+/// to the search statistics. It does nothing unless built with stats=yes.
+void MovePicker::count_generated() const {
+  pos.this_thread()->count(Search::SearchStats::MovesGenerated, endMoves - cur);
 }
 
 /// MovePicker::select() returns the next move satisfying a predicate function.
@@ -160,6 +305,7 @@ top:
   case QCAPTURE_INIT:
       cur = endBadCaptures = moves;
       endMoves = generate<CAPTURES>(pos, cur);
+      count_generated();
 
       score<CAPTURES>();
       ++stage;
@@ -195,8 +341,16 @@ top:
   case QUIET_INIT:
       if (!skipQuiets)
       {
+#if defined(USE_LAZY_QUIETS)
+          cur = endMoves = endBadCaptures;
+          for (PieceType pt : QuietBatches[quietBatch++])
+              if (pt != NO_PIECE_TYPE)
+                  endMoves = generate_quiets(pos, endMoves, pt);
+#else
           cur = endBadCaptures;
           endMoves = generate<QUIETS>(pos, cur);
+#endif
+          count_generated();
 
           score<QUIETS>();
           partial_insertion_sort(cur, endMoves, -3000 * depth);
@@ -212,6 +366,15 @@ top:
                                       && *cur != refutations[2].move;}))
           return *(cur - 1);
 
+#if defined(USE_LAZY_QUIETS)
+      // Generate the next batch of quiets, if any
+      if (!skipQuiets && quietBatch < QuietBatchNb)
+      {
+          --stage;
+          goto top;
+      }
+#endif
+
       // Prepare the pointers to loop over the bad captures
       cur = moves;
       endMoves = endBadCaptures;
@@ -225,6 +388,7 @@ top:
   case EVASION_INIT:
       cur = moves;
       endMoves = generate<EVASIONS>(pos, cur);
+      count_generated();
 
       score<EVASIONS>();
       ++stage;
@@ -251,6 +415,7 @@ top:
   case QCHECK_INIT:
       cur = moves;
       endMoves = generate<QUIET_CHECKS>(pos, cur);
+      count_generated();
 
       ++stage;
       [[fallthrough]];
@@ -138,6 +138,7 @@ public:
 private:
   template<PickType T, typename Pred> Move select(Pred);
   template<GenType> void score();
+  void count_generated() const;
   ExtMove* begin() { return cur; }
   ExtMove* end() { return endMoves; }
 
@@ -149,6 +150,9 @@ private:
   Move ttMove;
   ExtMove refutations[3], *cur, *endMoves, *endBadCaptures;
   int stage;
+#if defined(USE_LAZY_QUIETS)
+  int quietBatch = 0;
+#endif
   Square recaptureSquare;
   Value threshold;
   Depth depth;
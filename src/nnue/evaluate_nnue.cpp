@@ -18,12 +18,17 @@
 
 // Code for calculating NNUE evaluation function
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <set>
+#include <thread>
+#include <vector>
 
 #include "../evaluate.h"
 #include "../position.h"
 #include "../misc.h"
+#include "../thread.h"
 #include "../uci.h"
 
 #include "evaluate_nnue.h"
@@ -60,13 +65,38 @@ namespace Eval::NNUE {
   // Evaluation function file name
   std::string fileName;
 
+  // Network file in native layout the parameters point into, if any
+  void* mappedFile = nullptr;
+  size_t mappedSize;
+
+  // Header of a network file in native layout. The parameters follow at the
+  // given offsets as the raw bytes of the FeatureTransformer and Network
+  // objects, so that they can be used in place from a mapping of the file.
+  struct NativeHeader {
+    std::uint32_t version;    // kNativeVersion
+    std::uint32_t byteOrder;  // 0x01020304 in the byte order of the writer
+    std::uint32_t hashValue;  // kHashValue
+    char layout[12];          // kNativeLayout
+    std::uint64_t transformerOffset, transformerSize;
+    std::uint64_t networkOffset, networkSize;
+  };
+
+  // Copies of the parameters allocated on each NUMA node, indexed by node
+  // (by processor group under Windows, see WinProcGroup::node()).
+  // Empty unless the "Replicate NNUE" option is set and threads are bound.
+  struct Replica {
+    LargePagePtr<FeatureTransformer> feature_transformer;
+    AlignedPtr<Network> network;
+  };
+  std::vector<Replica> replicas;
+
   namespace Detail {
 
   // Initialize the evaluation function parameters
   template <typename T>
   void Initialize(AlignedPtr<T>& pointer) {
 
-    pointer.reset(reinterpret_cast<T*>(std_aligned_alloc(alignof(T), sizeof(T))));
+    pointer = AlignedPtr<T>(reinterpret_cast<T*>(std_aligned_alloc(alignof(T), sizeof(T))));
     std::memset(pointer.get(), 0, sizeof(T));
   }
 
@@ -74,10 +104,30 @@ namespace Eval::NNUE {
   void Initialize(LargePagePtr<T>& pointer) {
 
     static_assert(alignof(T) <= 4096, "aligned_large_pages_alloc() may fail for such a big alignment requirement of T");
-    pointer.reset(reinterpret_cast<T*>(aligned_large_pages_alloc(sizeof(T))));
+    pointer = LargePagePtr<T>(reinterpret_cast<T*>(aligned_large_pages_alloc(sizeof(T))));
     std::memset(pointer.get(), 0, sizeof(T));
   }
 
+  // Check that the parameters lie at a suitable place of a mapped network file
+  template <typename T>
+  bool Fits(std::size_t fileSize, std::uint64_t offset, std::uint64_t size) {
+
+    return offset % alignof(T) == 0 && size == sizeof(T) && offset <= fileSize && size <= fileSize - offset;
+  }
+
+  // Point the parameters into a mapped network file
+  template <typename T>
+  void Map(AlignedPtr<T>& pointer, char* mem) {
+
+    pointer = AlignedPtr<T>(reinterpret_cast<T*>(mem), AlignedDeleter<T>{true});
+  }
+
+  template <typename T>
+  void Map(LargePagePtr<T>& pointer, char* mem) {
+
+    pointer = LargePagePtr<T>(reinterpret_cast<T*>(mem), LargePageDeleter<T>{true});
+  }
+
   // Read evaluation function parameters
   template <typename T>
   bool ReadParameters(std::istream& stream, T& reference) {
@@ -112,35 +162,230 @@ namespace Eval::NNUE {
   }
 
   // Read network parameters
-  bool ReadParameters(std::istream& stream) {
+  bool ReadParameters(std::istream& stream, FeatureTransformer& transformer, Network& net) {
 
     std::uint32_t hash_value;
     std::string architecture;
     if (!ReadHeader(stream, &hash_value, &architecture)) return false;
     if (hash_value != kHashValue) return false;
-    if (!Detail::ReadParameters(stream, *feature_transformer)) return false;
-    if (!Detail::ReadParameters(stream, *network)) return false;
+    if (!Detail::ReadParameters(stream, transformer)) return false;
+    if (!Detail::ReadParameters(stream, net)) return false;
     return stream && stream.peek() == std::ios::traits_type::eof();
   }
 
+  // Return the copy of the parameters local to the NUMA node of the thread, if any
+  const Replica* local_replica(const Position& pos) {
+
+    const size_t node = size_t(pos.this_thread()->numaNode);
+    return node < replicas.size() ? &replicas[node] : nullptr;
+  }
+
   // Evaluation function. Perform differential calculation.
   Value evaluate(const Position& pos) {
 
+    const Replica* local = local_replica(pos);
+
     alignas(kCacheLineSize) TransformedFeatureType
         transformed_features[FeatureTransformer::kBufferSize];
-    feature_transformer->Transform(pos, transformed_features);
+    (local ? local->feature_transformer : feature_transformer)->Transform(
+        pos, transformed_features, pos.this_thread()->accumulatorCache);
     alignas(kCacheLineSize) char buffer[Network::kBufferSize];
-    const auto output = network->Propagate(transformed_features, buffer);
+    const auto output = (local ? local->network : network)->Propagate(transformed_features, buffer);
 
     return static_cast<Value>(output[0] / FV_SCALE);
   }
 
+  // Evaluate a set of positions, propagating them through the network kBatchSize
+  // at a time. All positions must belong to the same thread. The last batch is
+  // padded by repeating its last position.
+  void evaluate_batch(const Position* const* pos, size_t count, Value* values) {
+
+    if (!count)
+        return;
+
+    const Replica* local = local_replica(*pos[0]);
+    const FeatureTransformer& transformer = local ? *local->feature_transformer : *feature_transformer;
+    const Network& net = local ? *local->network : *network;
+
+    alignas(kCacheLineSize) TransformedFeatureType
+        transformed_features[kBatchSize][FeatureTransformer::kBufferSize];
+    alignas(kCacheLineSize) char buffer[kBatchSize * Network::kBufferSize];
+    const TransformedFeatureType* features[kBatchSize];
+    const Network::OutputType* output[kBatchSize];
+
+    for (size_t i = 0; i < count; i += kBatchSize)
+    {
+        const size_t n = std::min(kBatchSize, count - i);
+
+        for (size_t b = 0; b < kBatchSize; ++b)
+        {
+            if (b < n)
+                transformer.Transform(*pos[i + b], transformed_features[b],
+                                      pos[i + b]->this_thread()->accumulatorCache);
+
+            features[b] = transformed_features[std::min(b, n - 1)];
+        }
+
+        net.PropagateBatch(features, buffer, output);
+
+        for (size_t b = 0; b < n; ++b)
+            values[i + b] = static_cast<Value>(output[b][0] / FV_SCALE);
+    }
+  }
+
+  // Release the network file mapped by map_eval(), if any. The parameters
+  // must not point into it anymore.
+  void unmap_eval() {
+
+    if (mappedFile)
+        unmap_file(mappedFile, mappedSize);
+
+    mappedFile = nullptr;
+  }
+
   // Load eval, from a file stream or a memory stream
   bool load_eval(std::string name, std::istream& stream) {
 
     Initialize();
+    unmap_eval();
+    fileName = name;
+
+    // Cached accumulators are only valid for the net that computed them
+    for (Thread* th : Threads)
+        th->accumulatorCache.clear();
+
+    return ReadParameters(stream, *feature_transformer, *network);
+  }
+
+  // Load eval by mapping a network file in native layout, whose parameters are
+  // then used in place without any copy. Returns false, leaving the current
+  // parameters untouched, if the file is missing or not in native layout.
+  bool map_eval(std::string name, const std::string& path) {
+
+    size_t size;
+    char* mem = static_cast<char*>(map_file(path, &size));
+    if (!mem)
+        return false;
+
+    const NativeHeader* header = reinterpret_cast<const NativeHeader*>(mem);
+
+    if (   size < sizeof(NativeHeader)
+        || header->version != kNativeVersion
+        || header->byteOrder != 0x01020304u
+        || header->hashValue != kHashValue
+        || std::strncmp(header->layout, kNativeLayout, sizeof(header->layout))
+        || !Detail::Fits<FeatureTransformer>(size, header->transformerOffset, header->transformerSize)
+        || !Detail::Fits<Network>(size, header->networkOffset, header->networkSize))
+    {
+        unmap_file(mem, size);
+        return false;
+    }
+
+    Detail::Map(feature_transformer, mem + header->transformerOffset);
+    Detail::Map(network, mem + header->networkOffset);
+    unmap_eval();
+    mappedFile = mem;
+    mappedSize = size;
     fileName = name;
-    return ReadParameters(stream);
+
+    for (Thread* th : Threads)
+        th->accumulatorCache.clear();
+
+    return true;
+  }
+
+  // Name of the native layout of this build
+  const char* native_layout() {
+
+    return kNativeLayout;
+  }
+
+  // Convert a network file to the native layout of this build, see map_eval().
+  // The parameters are laid out at page aligned offsets.
+  bool convert_eval(std::istream& in, std::ostream& out) {
+
+    constexpr std::uint64_t kPageSize = 4096;
+
+    LargePagePtr<FeatureTransformer> transformer;
+    AlignedPtr<Network> net;
+    Detail::Initialize(transformer);
+    Detail::Initialize(net);
+
+    if (!ReadParameters(in, *transformer, *net))
+        return false;
+
+    NativeHeader header = {};
+    header.version = kNativeVersion;
+    header.byteOrder = 0x01020304u;
+    header.hashValue = kHashValue;
+    std::strncpy(header.layout, kNativeLayout, sizeof(header.layout));
+    header.transformerOffset = kPageSize;
+    header.transformerSize = sizeof(FeatureTransformer);
+    header.networkOffset = CeilToMultiple(kPageSize + sizeof(FeatureTransformer), kPageSize);
+    header.networkSize = sizeof(Network);
+
+    const std::vector<char> padding(kPageSize);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(padding.data(), header.transformerOffset - sizeof(header));
+    out.write(reinterpret_cast<const char*>(transformer.get()), header.transformerSize);
+    out.write(padding.data(), header.networkOffset - header.transformerOffset - header.transformerSize);
+    out.write(reinterpret_cast<const char*>(net.get()), header.networkSize);
+    return bool(out);
+  }
+
+  // Copy the loaded parameters to every NUMA node the search threads are
+  // bound to. Each copy is made by a helper thread bound like the first search
+  // thread of that node, so that with a first-touch policy it lives there.
+  void replicate() {
+
+    // The search threads may still be reading the current copies
+    Threads.main()->wait_for_search_finished();
+
+    replicas.clear();
+
+    if (!Options["Replicate NNUE"] || !feature_transformer || Threads.size() <= 8)
+        return;
+
+    std::vector<std::thread> threads;
+    std::vector<size_t> firstThread; // Index of the first search thread of each node
+
+    for (size_t idx = 0; idx < Threads.size(); ++idx)
+    {
+        const int node = WinProcGroup::node(idx);
+
+        if (node >= 0 && size_t(node) >= firstThread.size())
+            firstThread.resize(node + 1, Threads.size());
+
+        if (node >= 0 && firstThread[node] == Threads.size())
+            firstThread[node] = idx;
+    }
+
+    replicas.resize(firstThread.size());
+
+    for (size_t node = 0; node < firstThread.size(); ++node)
+    {
+        const size_t idx = firstThread[node];
+
+        if (idx == Threads.size())
+            continue;
+
+        threads.emplace_back([idx, node]() {
+
+            WinProcGroup::bindThisThread(idx);
+
+            Replica& r = replicas[node];
+            Detail::Initialize(r.feature_transformer);
+            Detail::Initialize(r.network);
+            std::memcpy(r.feature_transformer.get(), feature_transformer.get(), sizeof(FeatureTransformer));
+            std::memcpy(r.network.get(), network.get(), sizeof(Network));
+        });
+    }
+
+    for (std::thread& th : threads)
+        th.join();
+
+    if (!replicas.empty())
+        sync_cout << "info string NNUE replicated on " << threads.size() << " NUMA nodes" << sync_endl;
   }
 
 } // namespace Eval::NNUE
@@ -31,10 +31,13 @@ namespace Eval::NNUE {
   constexpr std::uint32_t kHashValue =
       FeatureTransformer::GetHashValue() ^ Network::GetHashValue();
 
-  // Deleter for automating release of memory area
+  // Deleter for automating release of memory area. Parameters pointing into
+  // a mapped network file are left alone, the whole mapping is released at once.
   template <typename T>
   struct AlignedDeleter {
+    bool mapped = false;
     void operator()(T* ptr) const {
+      if (mapped) return;
       ptr->~T();
       std_aligned_free(ptr);
     }
@@ -42,7 +45,9 @@ namespace Eval::NNUE {
 
   template <typename T>
   struct LargePageDeleter {
+    bool mapped = false;
     void operator()(T* ptr) const {
+      if (mapped) return;
       ptr->~T();
       aligned_large_pages_free(ptr);
     }
@@ -66,6 +66,27 @@ namespace Eval::NNUE::Features {
     }
   }
 
+  // Get a list of indices for features that differ from the given pieces
+  template <Side AssociatedKing>
+  void HalfKP<AssociatedKing>::AppendChangedIndices(
+      const Position& pos, const Bitboard* byColorBB, const Bitboard* byTypeBB,
+      Color perspective, IndexList* removed, IndexList* added) {
+
+    Square ksq = orient(perspective, pos.square<KING>(perspective));
+    for (Color c : { WHITE, BLACK })
+      for (PieceType pt = PAWN; pt <= QUEEN; ++pt) {
+        Piece pc = make_piece(c, pt);
+        Bitboard before = byColorBB[c] & byTypeBB[pt];
+        Bitboard now = pos.pieces(c, pt);
+        Bitboard bb = before & ~now;
+        while (bb)
+          removed->push_back(MakeIndex(perspective, pop_lsb(&bb), pc, ksq));
+        bb = now & ~before;
+        while (bb)
+          added->push_back(MakeIndex(perspective, pop_lsb(&bb), pc, ksq));
+      }
+  }
+
   template class HalfKP<Side::kFriend>;
 
 }  // namespace Eval::NNUE::Features
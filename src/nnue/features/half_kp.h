@@ -53,6 +53,11 @@ namespace Eval::NNUE::Features {
     static void AppendChangedIndices(const Position& pos, const DirtyPiece& dp, Color perspective,
                                      IndexList* removed, IndexList* added);
 
+    // Get a list of indices for features that differ from the given pieces
+    static void AppendChangedIndices(const Position& pos, const Bitboard* byColorBB,
+                                     const Bitboard* byTypeBB, Color perspective,
+                                     IndexList* removed, IndexList* added);
+
    private:
     // Index of a feature for a given king position and another piece on some square
     static IndexType MakeIndex(Color perspective, Square s, Piece pc, Square sq_k);
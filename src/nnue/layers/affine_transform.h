@@ -23,9 +23,16 @@
 
 #include <iostream>
 #include "../nnue_common.h"
+#include "input_slice.h"
 
 namespace Eval::NNUE::Layers {
 
+  template <typename Layer>
+  struct IsInputSlice : std::false_type {};
+
+  template <IndexType OutputDimensions, IndexType Offset>
+  struct IsInputSlice<InputSlice<OutputDimensions, Offset>> : std::true_type {};
+
   // Affine transformation layer
   template <typename PreviousLayer, IndexType OutputDimensions>
   class AffineTransform {
@@ -42,6 +49,17 @@ namespace Eval::NNUE::Layers {
     static constexpr IndexType kPaddedInputDimensions =
         CeilToMultiple<IndexType>(kInputDimensions, kMaxSimdWidth);
 
+    // The clipped output of the feature transformer has many zeros, so on the
+    // architectures with a kernel for it the first layer only multiplies the
+    // non-zero 4-byte blocks of its input. The weights are then stored column
+    // by column, each column holding the weights of a block for all outputs.
+  #if defined(USE_AVX2)
+    static constexpr bool kSparseInput =
+        IsInputSlice<PreviousLayer>::value && kOutputDimensions % 8 == 0;
+  #else
+    static constexpr bool kSparseInput = false;
+  #endif
+
     // Size of forward propagation buffer used in this layer
     static constexpr std::size_t kSelfBufferSize =
         CeilToMultiple(kOutputDimensions * sizeof(OutputType), kCacheLineSize);
@@ -65,7 +83,7 @@ namespace Eval::NNUE::Layers {
       for (std::size_t i = 0; i < kOutputDimensions; ++i)
         biases_[i] = read_little_endian<BiasType>(stream);
       for (std::size_t i = 0; i < kOutputDimensions * kPaddedInputDimensions; ++i)
-        weights_[i] = read_little_endian<WeightType>(stream);
+        weights_[WeightIndex(i)] = read_little_endian<WeightType>(stream);
       return !stream.fail();
     }
 
@@ -75,6 +93,149 @@ namespace Eval::NNUE::Layers {
       const auto input = previous_layer_.Propagate(
           transformed_features, buffer + kSelfBufferSize);
       const auto output = reinterpret_cast<OutputType*>(buffer);
+      Affine(input, output);
+      return output;
+    }
+
+    // Forward propagation of kBatchSize positions at once. Each chunk of a
+    // weight row is loaded once and multiplied with the inputs of all the
+    // positions of the batch, which raises the arithmetic intensity. On AVX2
+    // the sparse first layer is the exception, see below.
+    void PropagateBatch(
+        const TransformedFeatureType* const* transformed_features,
+        char* buffer, const OutputType** output) const {
+      const InputType* input[kBatchSize];
+      OutputType* out[kBatchSize];
+      previous_layer_.PropagateBatch(
+          transformed_features, buffer + kBatchSize * kSelfBufferSize, input);
+      for (std::size_t b = 0; b < kBatchSize; ++b)
+        output[b] = out[b] = reinterpret_cast<OutputType*>(buffer + b * kSelfBufferSize);
+
+  #if defined(USE_AVX2)
+      // The sparse first layer is not batched. Its weights (16 KB for 512x32)
+      // stay in L1, and merging the non-zero blocks of the positions of a batch
+      // into one list, so that each weight column is loaded once per group of
+      // positions, makes about 3 times more blocks to multiply: with 21 of 128
+      // non-zero blocks per position the merged list of 4 positions has about
+      // 61. Measured with evalbatch, that kernel was not faster than running
+      // SparseAffine() on each position, so only the dense layers that follow
+      // share their weight loads across the batch.
+      if constexpr (kSparseInput) {
+        for (std::size_t b = 0; b < kBatchSize; ++b)
+          SparseAffine(input[b], out[b]);
+        return;
+      }
+
+      constexpr IndexType kNumChunks = kPaddedInputDimensions / kSimdWidth;
+  #if !defined(USE_VNNI)
+      const __m256i kOnes = _mm256_set1_epi16(1);
+  #endif
+
+      for (IndexType i = 0; i < kOutputDimensions; ++i) {
+        const auto row = reinterpret_cast<const __m256i*>(&weights_[i * kPaddedInputDimensions]);
+        __m256i sum[kBatchSize];
+        for (std::size_t b = 0; b < kBatchSize; ++b)
+          sum[b] = _mm256_setzero_si256();
+
+        for (IndexType j = 0; j < kNumChunks; ++j) {
+          const __m256i w = _mm256_load_si256(&row[j]);
+          for (std::size_t b = 0; b < kBatchSize; ++b) {
+            const __m256i in = _mm256_loadA_si256(&reinterpret_cast<const __m256i*>(input[b])[j]);
+  #if defined(USE_VNNI)
+            sum[b] = _mm256_dpbusd_epi32(sum[b], in, w);
+  #else
+            __m256i product = _mm256_maddubs_epi16(in, w);
+            product = _mm256_madd_epi16(product, kOnes);
+            sum[b] = _mm256_add_epi32(sum[b], product);
+  #endif
+          }
+        }
+
+        for (std::size_t b = 0; b < kBatchSize; ++b) {
+          __m128i sum128 = _mm_add_epi32(_mm256_castsi256_si128(sum[b]), _mm256_extracti128_si256(sum[b], 1));
+          sum128 = _mm_add_epi32(sum128, _mm_shuffle_epi32(sum128, _MM_PERM_BADC));
+          sum128 = _mm_add_epi32(sum128, _mm_shuffle_epi32(sum128, _MM_PERM_CDAB));
+          out[b][i] = _mm_cvtsi128_si32(sum128) + biases_[i];
+        }
+      }
+
+  #else
+      for (std::size_t b = 0; b < kBatchSize; ++b)
+        Affine(input[b], out[b]);
+  #endif
+    }
+
+   private:
+    // Index in weights_ of the i-th weight of the evaluation file
+    static constexpr std::size_t WeightIndex(std::size_t i) {
+
+      if (!kSparseInput)
+        return i;
+
+      const std::size_t row = i / kPaddedInputDimensions;
+      const std::size_t col = i % kPaddedInputDimensions;
+      return (col / 4 * kOutputDimensions + row) * 4 + col % 4;
+    }
+
+  #if defined(USE_AVX2)
+    // Find the non-zero 4-byte blocks of the input with a movemask, then add
+    // the weight column of each of them to all the outputs at once
+    void SparseAffine(const InputType* input, OutputType* output) const {
+
+      constexpr IndexType kNumChunks = kPaddedInputDimensions / kSimdWidth;
+      constexpr IndexType kNumRegs = kOutputDimensions / 8;
+      const auto input_vector = reinterpret_cast<const __m256i*>(input);
+      const __m256i kZero = _mm256_setzero_si256();
+  #if !defined(USE_VNNI)
+      const __m256i kOnes = _mm256_set1_epi16(1);
+  #endif
+
+      std::uint16_t nnz[kPaddedInputDimensions / 4];
+      IndexType count = 0;
+      for (IndexType j = 0; j < kNumChunks; ++j) {
+        const unsigned zeros = _mm256_movemask_ps(_mm256_castsi256_ps(
+            _mm256_cmpeq_epi32(_mm256_loadA_si256(&input_vector[j]), kZero)));
+        for (IndexType k = 0; k < 8; ++k) {
+          nnz[count] = j * 8 + k;
+          count += !((zeros >> k) & 1);
+        }
+      }
+
+      __m256i sum[kNumRegs];
+      const auto biases = reinterpret_cast<const __m256i*>(biases_);
+      for (IndexType k = 0; k < kNumRegs; ++k)
+        sum[k] = _mm256_load_si256(&biases[k]);
+
+      for (IndexType i = 0; i < count; ++i) {
+        std::int32_t block;
+        std::memcpy(&block, &input[nnz[i] * 4], sizeof(block));
+        const __m256i in = _mm256_set1_epi32(block);
+        const auto column = reinterpret_cast<const __m256i*>(&weights_[nnz[i] * 4 * kOutputDimensions]);
+        for (IndexType k = 0; k < kNumRegs; ++k) {
+  #if defined(USE_VNNI)
+          sum[k] = _mm256_dpbusd_epi32(sum[k], in, _mm256_load_si256(&column[k]));
+  #else
+          __m256i product = _mm256_maddubs_epi16(in, _mm256_load_si256(&column[k]));
+          product = _mm256_madd_epi16(product, kOnes);
+          sum[k] = _mm256_add_epi32(sum[k], product);
+  #endif
+        }
+      }
+
+      const auto output_vector = reinterpret_cast<__m256i*>(output);
+      for (IndexType k = 0; k < kNumRegs; ++k)
+        _mm256_storeA_si256(&output_vector[k], sum[k]);
+    }
+  #endif
+
+    void Affine(const InputType* input, OutputType* output) const {
+
+  #if defined(USE_AVX2)
+      if constexpr (kSparseInput) {
+        SparseAffine(input, output);
+        return;
+      }
+  #endif
 
   #if defined(USE_AVX512)
       constexpr IndexType kNumChunks = kPaddedInputDimensions / (kSimdWidth * 2);
@@ -247,10 +408,8 @@ namespace Eval::NNUE::Layers {
   #if defined(USE_MMX)
       _mm_empty();
   #endif
-      return output;
     }
 
-   private:
     using BiasType = OutputType;
     using WeightType = std::int8_t;
 
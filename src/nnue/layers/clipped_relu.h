@@ -65,6 +65,26 @@ namespace Eval::NNUE::Layers {
       const auto input = previous_layer_.Propagate(
           transformed_features, buffer + kSelfBufferSize);
       const auto output = reinterpret_cast<OutputType*>(buffer);
+      Clip(input, output);
+      return output;
+    }
+
+    // Forward propagation of kBatchSize positions at once
+    void PropagateBatch(
+        const TransformedFeatureType* const* transformed_features,
+        char* buffer, const OutputType** output) const {
+      const InputType* input[kBatchSize];
+      previous_layer_.PropagateBatch(
+          transformed_features, buffer + kBatchSize * kSelfBufferSize, input);
+      for (std::size_t b = 0; b < kBatchSize; ++b) {
+        const auto out = reinterpret_cast<OutputType*>(buffer + b * kSelfBufferSize);
+        Clip(input[b], out);
+        output[b] = out;
+      }
+    }
+
+   private:
+    static void Clip(const InputType* input, OutputType* output) {
 
   #if defined(USE_AVX2)
       constexpr IndexType kNumChunks = kInputDimensions / kSimdWidth;
@@ -154,10 +174,8 @@ namespace Eval::NNUE::Layers {
         output[i] = static_cast<OutputType>(
             std::max(0, std::min(127, input[i] >> kWeightScaleBits)));
       }
-      return output;
     }
 
-   private:
     PreviousLayer previous_layer_;
   };
 
@@ -60,6 +60,14 @@ class InputSlice {
     return transformed_features + Offset;
   }
 
+  // Forward propagation of kBatchSize positions at once
+  void PropagateBatch(
+      const TransformedFeatureType* const* transformed_features,
+      char* /*buffer*/, const OutputType** output) const {
+    for (std::size_t b = 0; b < kBatchSize; ++b)
+      output[b] = transformed_features[b] + Offset;
+  }
+
  private:
 };
 
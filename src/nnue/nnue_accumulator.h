@@ -21,6 +21,8 @@
 #ifndef NNUE_ACCUMULATOR_H_INCLUDED
 #define NNUE_ACCUMULATOR_H_INCLUDED
 
+#include <cstring>
+
 #include "nnue_architecture.h"
 
 namespace Eval::NNUE {
@@ -28,11 +30,33 @@ namespace Eval::NNUE {
   // The accumulator of a StateInfo without parent is set to the INIT state
   enum AccumulatorState { EMPTY, COMPUTED, INIT };
 
-  // Class that holds the result of affine transformation of input features
+  // Class that holds the result of affine transformation of input features.
+  // Accumulators are not stored in StateInfo but in a per thread stack indexed
+  // by StateInfo::accumulatorIdx, which is the distance from the root. The
+  // state of each perspective is kept in StateInfo, so that making a move
+  // does not touch the stack.
   struct alignas(kCacheLineSize) Accumulator {
     std::int16_t
         accumulation[2][kRefreshTriggers.size()][kTransformedFeatureDimensions];
-    AccumulatorState state[2];
+  };
+
+  // Per thread cache used to refresh accumulators ("Finny tables"). For each
+  // king square and perspective it keeps the pieces seen the last time an
+  // accumulator was refreshed with the king there, and the sum of their feature
+  // weights (biases excluded, so that an all-zero entry is valid for an empty
+  // board). A refresh then only has to apply the difference with the current
+  // pieces, which is small for king walks and king shuffles.
+  struct AccumulatorCache {
+
+    struct alignas(kCacheLineSize) Entry {
+      std::int16_t accumulation[kTransformedFeatureDimensions];
+      Bitboard byColorBB[COLOR_NB];
+      Bitboard byTypeBB[PIECE_TYPE_NB];
+    };
+
+    void clear() { std::memset(entries, 0, sizeof(entries)); }
+
+    Entry entries[SQUARE_NB][COLOR_NB];
   };
 
 }  // namespace Eval::NNUE
@@ -71,6 +71,44 @@ namespace Eval::NNUE {
   // Version of the evaluation file
   constexpr std::uint32_t kVersion = 0x7AF32F16u;
 
+  // Version of the evaluation file in native layout, which can be mapped. It
+  // must change whenever the in-memory order of the parameters changes, like
+  // the sparse first layer weights of AVX2 builds did.
+  constexpr std::uint32_t kNativeVersion = 0x7AF32F18u;
+
+  // SIMD path of the kernels of this build. It tags network files in native
+  // layout, which are only mapped by builds using the same kernels.
+  #if defined(USE_VNNI) && defined(USE_AVX512)
+  constexpr char kNativeLayout[] = "vnni512";
+
+  #elif defined(USE_VNNI)
+  constexpr char kNativeLayout[] = "vnni256";
+
+  #elif defined(USE_AVX512)
+  constexpr char kNativeLayout[] = "avx512";
+
+  #elif defined(USE_AVX2)
+  constexpr char kNativeLayout[] = "avx2";
+
+  #elif defined(USE_SSE41)
+  constexpr char kNativeLayout[] = "sse41";
+
+  #elif defined(USE_SSSE3)
+  constexpr char kNativeLayout[] = "ssse3";
+
+  #elif defined(USE_SSE2)
+  constexpr char kNativeLayout[] = "sse2";
+
+  #elif defined(USE_MMX)
+  constexpr char kNativeLayout[] = "mmx";
+
+  #elif defined(USE_NEON)
+  constexpr char kNativeLayout[] = "neon";
+
+  #else
+  constexpr char kNativeLayout[] = "generic";
+  #endif
+
   // Constant used in evaluation value calculation
   constexpr int FV_SCALE = 16;
   constexpr int kWeightScaleBits = 6;
@@ -94,6 +132,9 @@ namespace Eval::NNUE {
 
   constexpr std::size_t kMaxSimdWidth = 32;
 
+  // Number of positions propagated together by evaluate_batch()
+  constexpr std::size_t kBatchSize = 4;
+
   // unique number for each piece type on each square
   enum {
     PS_NONE     =  0,
@@ -120,12 +120,12 @@ namespace Eval::NNUE {
     }
 
     // Convert input features
-    void Transform(const Position& pos, OutputType* output) const {
+    void Transform(const Position& pos, OutputType* output, AccumulatorCache& cache) const {
 
-      UpdateAccumulator(pos, WHITE);
-      UpdateAccumulator(pos, BLACK);
+      UpdateAccumulator(pos, WHITE, cache);
+      UpdateAccumulator(pos, BLACK, cache);
 
-      const auto& accumulation = pos.state()->accumulator.accumulation;
+      const auto& accumulation = pos.accumulator(pos.state()).accumulation;
 
   #if defined(USE_AVX2)
       constexpr IndexType kNumChunks = kHalfDimensions / kSimdWidth;
@@ -219,7 +219,7 @@ namespace Eval::NNUE {
     }
 
    private:
-    void UpdateAccumulator(const Position& pos, const Color c) const {
+    void UpdateAccumulator(const Position& pos, const Color c, AccumulatorCache& cache) const {
 
   #ifdef VECTOR
       // Gcc-10.2 unnecessarily spills AVX2 registers if this array
@@ -231,7 +231,7 @@ namespace Eval::NNUE {
       // of the estimated gain in terms of features to be added/subtracted.
       StateInfo *st = pos.state(), *next = nullptr;
       int gain = popcount(pos.pieces()) - 2;
-      while (st->accumulator.state[c] == EMPTY)
+      while (st->accumulatorState[c] == EMPTY)
       {
         auto& dp = st->dirtyPiece;
         // The first condition tests whether an incremental update is
@@ -246,7 +246,7 @@ namespace Eval::NNUE {
         st = st->previous;
       }
 
-      if (st->accumulator.state[c] == COMPUTED)
+      if (st->accumulatorState[c] == COMPUTED)
       {
         if (next == nullptr)
           return;
@@ -266,8 +266,8 @@ namespace Eval::NNUE {
               st2->dirtyPiece, c, &removed[1], &added[1]);
 
         // Mark the accumulators as computed.
-        next->accumulator.state[c] = COMPUTED;
-        pos.state()->accumulator.state[c] = COMPUTED;
+        next->accumulatorState[c] = COMPUTED;
+        pos.state()->accumulatorState[c] = COMPUTED;
 
         // Now update the accumulators listed in info[], where the last element is a sentinel.
         StateInfo *info[3] =
@@ -277,7 +277,7 @@ namespace Eval::NNUE {
         {
           // Load accumulator
           auto accTile = reinterpret_cast<vec_t*>(
-            &st->accumulator.accumulation[c][0][j * kTileHeight]);
+            &pos.accumulator(st).accumulation[c][0][j * kTileHeight]);
           for (IndexType k = 0; k < kNumRegs; ++k)
             acc[k] = vec_load(&accTile[k]);
 
@@ -303,7 +303,7 @@ namespace Eval::NNUE {
 
             // Store accumulator
             accTile = reinterpret_cast<vec_t*>(
-              &info[i]->accumulator.accumulation[c][0][j * kTileHeight]);
+              &pos.accumulator(info[i]).accumulation[c][0][j * kTileHeight]);
             for (IndexType k = 0; k < kNumRegs; ++k)
               vec_store(&accTile[k], acc[k]);
           }
@@ -312,8 +312,8 @@ namespace Eval::NNUE {
   #else
         for (IndexType i = 0; info[i]; ++i)
         {
-          std::memcpy(info[i]->accumulator.accumulation[c][0],
-              st->accumulator.accumulation[c][0],
+          std::memcpy(pos.accumulator(info[i]).accumulation[c][0],
+              pos.accumulator(st).accumulation[c][0],
               kHalfDimensions * sizeof(BiasType));
           st = info[i];
 
@@ -323,7 +323,7 @@ namespace Eval::NNUE {
             const IndexType offset = kHalfDimensions * index;
 
             for (IndexType j = 0; j < kHalfDimensions; ++j)
-              st->accumulator.accumulation[c][0][j] -= weights_[offset + j];
+              pos.accumulator(st).accumulation[c][0][j] -= weights_[offset + j];
           }
 
           // Difference calculation for the activated features
@@ -332,28 +332,40 @@ namespace Eval::NNUE {
             const IndexType offset = kHalfDimensions * index;
 
             for (IndexType j = 0; j < kHalfDimensions; ++j)
-              st->accumulator.accumulation[c][0][j] += weights_[offset + j];
+              pos.accumulator(st).accumulation[c][0][j] += weights_[offset + j];
           }
         }
   #endif
       }
       else
       {
-        // Refresh the accumulator
-        auto& accumulator = pos.state()->accumulator;
-        accumulator.state[c] = COMPUTED;
-        Features::IndexList active;
-        Features::HalfKP<Features::Side::kFriend>::AppendActiveIndices(pos, c, &active);
+        // Refresh the accumulator, starting from the cached one for the same
+        // king square and perspective and applying the difference in pieces.
+        auto& accumulator = pos.accumulator(pos.state());
+        auto& entry = cache.entries[pos.square<KING>(c)][c];
+        pos.state()->accumulatorState[c] = COMPUTED;
+        Features::IndexList removed, added;
+        Features::HalfKP<Features::Side::kFriend>::AppendChangedIndices(pos,
+            entry.byColorBB, entry.byTypeBB, c, &removed, &added);
 
   #ifdef VECTOR
         for (IndexType j = 0; j < kHalfDimensions / kTileHeight; ++j)
         {
-          auto biasesTile = reinterpret_cast<const vec_t*>(
-              &biases_[j * kTileHeight]);
+          auto entryTile = reinterpret_cast<vec_t*>(
+              &entry.accumulation[j * kTileHeight]);
           for (IndexType k = 0; k < kNumRegs; ++k)
-            acc[k] = biasesTile[k];
+            acc[k] = vec_load(&entryTile[k]);
 
-          for (const auto index : active)
+          for (const auto index : removed)
+          {
+            const IndexType offset = kHalfDimensions * index + j * kTileHeight;
+            auto column = reinterpret_cast<const vec_t*>(&weights_[offset]);
+
+            for (unsigned k = 0; k < kNumRegs; ++k)
+              acc[k] = vec_sub_16(acc[k], column[k]);
+          }
+
+          for (const auto index : added)
           {
             const IndexType offset = kHalfDimensions * index + j * kTileHeight;
             auto column = reinterpret_cast<const vec_t*>(&weights_[offset]);
@@ -362,24 +374,42 @@ namespace Eval::NNUE {
               acc[k] = vec_add_16(acc[k], column[k]);
           }
 
+          auto biasesTile = reinterpret_cast<const vec_t*>(
+              &biases_[j * kTileHeight]);
           auto accTile = reinterpret_cast<vec_t*>(
               &accumulator.accumulation[c][0][j * kTileHeight]);
           for (unsigned k = 0; k < kNumRegs; k++)
-            vec_store(&accTile[k], acc[k]);
+          {
+            vec_store(&entryTile[k], acc[k]);
+            vec_store(&accTile[k], vec_add_16(acc[k], biasesTile[k]));
+          }
         }
 
   #else
-        std::memcpy(accumulator.accumulation[c][0], biases_,
-            kHalfDimensions * sizeof(BiasType));
+        for (const auto index : removed)
+        {
+          const IndexType offset = kHalfDimensions * index;
 
-        for (const auto index : active)
+          for (IndexType j = 0; j < kHalfDimensions; ++j)
+            entry.accumulation[j] -= weights_[offset + j];
+        }
+
+        for (const auto index : added)
         {
           const IndexType offset = kHalfDimensions * index;
 
           for (IndexType j = 0; j < kHalfDimensions; ++j)
-            accumulator.accumulation[c][0][j] += weights_[offset + j];
+            entry.accumulation[j] += weights_[offset + j];
         }
+
+        for (IndexType j = 0; j < kHalfDimensions; ++j)
+          accumulator.accumulation[c][0][j] = entry.accumulation[j] + biases_[j];
   #endif
+
+        for (Color col : { WHITE, BLACK })
+          entry.byColorBB[col] = pos.pieces(col);
+        for (PieceType pt = PAWN; pt <= QUEEN; ++pt)
+          entry.byTypeBB[pt] = pos.pieces(pt);
       }
 
   #if defined(USE_MMX)
@@ -18,6 +18,8 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <iostream>
 
 #include "bitboard.h"
 #include "pawns.h"
@@ -178,6 +180,70 @@ namespace {
     return score;
   }
 
+  // SharedEntry holds the king independent part of a Pawns::Entry in the
+  // table shared by all threads. Entries are written without locks, so the
+  // stored key is xored with all the data words and an entry torn by
+  // concurrent writes fails verification and is treated as a miss.
+  struct SharedEntry {
+
+    Key key() const {
+      Key k = keyXorData;
+      for (uint64_t d : data)
+          k ^= d;
+      return k;
+    }
+
+    Key keyXorData;
+    uint64_t data[7];
+  };
+
+  static_assert(sizeof(SharedEntry) == 64, "SharedEntry should fill a cache line");
+
+  SharedEntry* sharedTable = nullptr;
+  size_t sharedMask;
+
+  SharedEntry* shared_entry(Key key) { return &sharedTable[(key >> 32) & sharedMask]; }
+
+  // load() fills the pawn data of e from the shared table. It returns
+  // false if the slot does not hold key or was torn by a concurrent store.
+  bool load(Pawns::Entry* e, Key key) {
+
+    const SharedEntry se = *shared_entry(key); // Copy first, then verify the copy
+    if (se.key() != key)
+        return false;
+
+    e->scores[WHITE]          = Score(int32_t(uint32_t(se.data[0])));
+    e->scores[BLACK]          = Score(int32_t(uint32_t(se.data[0] >> 32)));
+    e->passedPawns[WHITE]     = se.data[1] & ~Rank1BB;
+    e->passedPawns[BLACK]     = se.data[2];
+    e->pawnAttacks[WHITE]     = se.data[3];
+    e->pawnAttacks[BLACK]     = se.data[4];
+    e->pawnAttacksSpan[WHITE] = se.data[5];
+    e->pawnAttacksSpan[BLACK] = se.data[6];
+    e->blockedCount           = int(se.data[1] & Rank1BB);
+    e->kingSquares[WHITE]     = e->kingSquares[BLACK] = SQ_NONE;
+    return true;
+  }
+
+  // store() publishes the pawn data of e in the shared table. Passed pawns
+  // are never on the first rank, so the blocked pawns count (at most 16) is
+  // kept in the rank 1 bits of the white passed pawns.
+  void store(const Pawns::Entry* e) {
+
+    SharedEntry se;
+    se.data[0] = uint32_t(e->scores[WHITE]) | uint64_t(uint32_t(e->scores[BLACK])) << 32;
+    se.data[1] = e->passedPawns[WHITE] | Bitboard(e->blockedCount);
+    se.data[2] = e->passedPawns[BLACK];
+    se.data[3] = e->pawnAttacks[WHITE];
+    se.data[4] = e->pawnAttacks[BLACK];
+    se.data[5] = e->pawnAttacksSpan[WHITE];
+    se.data[6] = e->pawnAttacksSpan[BLACK];
+    se.keyXorData = e->key;
+    se.keyXorData = se.key();
+
+    *shared_entry(e->key) = se;
+  }
+
 } // namespace
 
 namespace Pawns {
@@ -187,6 +253,8 @@ namespace Pawns {
 /// the pawns hash table. It returns a pointer to the Entry if the position
 /// is found. Otherwise a new Entry is computed and stored there, so we don't
 /// have to recompute all when the same pawns configuration occurs again.
+/// When the shared pawn hash is enabled, it is looked up on a miss of the
+/// thread's own table, and refilled with each newly computed Entry.
 
 Entry* probe(const Position& pos) {
 
@@ -197,14 +265,51 @@ Entry* probe(const Position& pos) {
       return e;
 
   e->key = key;
+
+  if (sharedTable && load(e, key))
+      return e;
+
   e->blockedCount = 0;
   e->scores[WHITE] = evaluate<WHITE>(pos, e);
   e->scores[BLACK] = evaluate<BLACK>(pos, e);
 
+  if (sharedTable)
+      store(e);
+
   return e;
 }
 
 
+/// Pawns::resize_shared() sets the size in megabytes of the pawn hash table
+/// shared by all threads. A size of zero disables the shared table.
+
+void resize_shared(size_t mbSize) {
+
+  Threads.main()->wait_for_search_finished();
+
+  aligned_large_pages_free(sharedTable);
+  sharedTable = nullptr;
+
+  if (!mbSize)
+      return;
+
+  size_t count = 1;
+  while (2 * count * sizeof(SharedEntry) <= mbSize * 1024 * 1024)
+      count *= 2;
+
+  sharedTable = static_cast<SharedEntry*>(aligned_large_pages_alloc(count * sizeof(SharedEntry)));
+  if (!sharedTable)
+  {
+      std::cerr << "Failed to allocate " << mbSize
+                << "MB for shared pawn hash table." << std::endl;
+      exit(EXIT_FAILURE);
+  }
+
+  std::memset(static_cast<void*>(sharedTable), 0, count * sizeof(SharedEntry));
+  sharedMask = count - 1;
+}
+
+
 /// Entry::evaluate_shelter() calculates the shelter bonus and the storm
 /// penalty for a king, looking at the king file and the two closest files.
 
@@ -61,9 +61,10 @@ struct Entry {
   int blockedCount;
 };
 
-typedef HashTable<Entry, 131072> Table;
+typedef HashTable<Entry> Table;
 
 Entry* probe(const Position& pos);
+void resize_shared(size_t mbSize);
 
 } // namespace Pawns
 
@@ -278,9 +278,10 @@ Position& Position::set(const string& fenStr, bool isChess960, StateInfo* si, Th
 
   chess960 = isChess960;
   thisThread = th;
+  accumulators = th ? th->accumulators : nullptr;
   set_state(st);
-  st->accumulator.state[WHITE] = Eval::NNUE::INIT;
-  st->accumulator.state[BLACK] = Eval::NNUE::INIT;
+  st->accumulatorState[WHITE] = Eval::NNUE::INIT;
+  st->accumulatorState[BLACK] = Eval::NNUE::INIT;
 
   assert(pos_is_ok());
 
@@ -705,8 +706,9 @@ void Position::do_move(Move m, StateInfo& newSt, bool givesCheck) {
   ++st->pliesFromNull;
 
   // Used by NNUE
-  st->accumulator.state[WHITE] = Eval::NNUE::EMPTY;
-  st->accumulator.state[BLACK] = Eval::NNUE::EMPTY;
+  st->accumulatorState[WHITE] = Eval::NNUE::EMPTY;
+  st->accumulatorState[BLACK] = Eval::NNUE::EMPTY;
+  st->accumulatorIdx = st->previous->accumulatorIdx + 1;
   auto& dp = st->dirtyPiece;
   dp.dirty_num = 1;
 
@@ -753,6 +755,10 @@ void Position::do_move(Move m, StateInfo& newSt, bool givesCheck) {
           }
 
           st->pawnKey ^= Zobrist::psq[captured][capsq];
+
+          // Prefetch access to pawnsTable, unless a pawn move changes the key again
+          if (type_of(pc) != PAWN)
+              prefetch(thisThread->pawnsTable[st->pawnKey]);
       }
       else
           st->nonPawnMaterial[them] -= PieceValue[MG][captured];
@@ -847,13 +853,15 @@ void Position::do_move(Move m, StateInfo& newSt, bool givesCheck) {
           st->pawnKey ^= Zobrist::psq[pc][to];
           st->materialKey ^=  Zobrist::psq[promotion][pieceCount[promotion]-1]
                             ^ Zobrist::psq[pc][pieceCount[pc]];
+          prefetch(thisThread->materialTable[st->materialKey]);
 
           // Update material
           st->nonPawnMaterial[us] += PieceValue[MG][promotion];
       }
 
-      // Update pawn hash key
+      // Update pawn hash key and prefetch access to pawnsTable
       st->pawnKey ^= Zobrist::psq[pc][from] ^ Zobrist::psq[pc][to];
+      prefetch(thisThread->pawnsTable[st->pawnKey]);
 
       // Reset rule 50 draw counter
       st->rule50 = 0;
@@ -999,15 +1007,16 @@ void Position::do_null_move(StateInfo& newSt) {
   assert(!checkers());
   assert(&newSt != st);
 
-  std::memcpy(&newSt, st, offsetof(StateInfo, accumulator));
+  std::memcpy(&newSt, st, offsetof(StateInfo, accumulatorState));
 
   newSt.previous = st;
   st = &newSt;
 
   st->dirtyPiece.dirty_num = 0;
   st->dirtyPiece.piece[0] = NO_PIECE; // Avoid checks in UpdateAccumulator()
-  st->accumulator.state[WHITE] = Eval::NNUE::EMPTY;
-  st->accumulator.state[BLACK] = Eval::NNUE::EMPTY;
+  st->accumulatorState[WHITE] = Eval::NNUE::EMPTY;
+  st->accumulatorState[BLACK] = Eval::NNUE::EMPTY;
+  st->accumulatorIdx = st->previous->accumulatorIdx + 1;
 
   if (st->epSquare != SQ_NONE)
   {
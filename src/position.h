@@ -57,7 +57,8 @@ struct StateInfo {
   int        repetition;
 
   // Used by NNUE
-  Eval::NNUE::Accumulator accumulator;
+  Eval::NNUE::AccumulatorState accumulatorState[COLOR_NB];
+  int        accumulatorIdx;
   DirtyPiece dirtyPiece;
 };
 
@@ -95,6 +96,7 @@ public:
   Bitboard pieces(Color c, PieceType pt) const;
   Bitboard pieces(Color c, PieceType pt1, PieceType pt2) const;
   Piece piece_on(Square s) const;
+  const Piece* board_data() const { return board; }
   Square ep_square() const;
   bool empty(Square s) const;
   template<PieceType Pt> int count(Color c) const;
@@ -171,6 +173,7 @@ public:
 
   // Used by NNUE
   StateInfo* state() const;
+  Eval::NNUE::Accumulator& accumulator(const StateInfo* si) const;
 
 private:
   // Initialization helpers (used while setting up a position)
@@ -199,6 +202,7 @@ private:
   Color sideToMove;
   Score psq;
   Thread* thisThread;
+  Eval::NNUE::Accumulator* accumulators;
   StateInfo* st;
   bool chess960;
 };
@@ -444,4 +448,10 @@ inline StateInfo* Position::state() const {
   return st;
 }
 
+inline Eval::NNUE::Accumulator& Position::accumulator(const StateInfo* si) const {
+
+  assert(accumulators && si->accumulatorIdx <= MAX_PLY);
+  return accumulators[si->accumulatorIdx];
+}
+
 #endif // #ifndef POSITION_H_INCLUDED
@@ -158,28 +158,124 @@ namespace {
   void update_all_stats(const Position& pos, Stack* ss, Move bestMove, Value bestValue, Value beta, Square prevSq,
                         Move* quietsSearched, int quietCount, Move* capturesSearched, int captureCount, Depth depth);
 
+  // PerftTable memoizes the leaf counts of perft() subtrees by key and depth.
+  // It is shared by all the threads without locks: each entry stores the key
+  // xor-ed with the data, so that an entry torn by concurrent writes does not
+  // verify and is ignored. It is allocated for each perft run, next to the TT,
+  // and freed at its end, so its size is kept small and independent of "Hash".
+  constexpr size_t PerftHashMB = 64;
+
+  class PerftTable {
+
+    struct Entry {
+      Key keyXorData;
+      uint64_t data; // Leaf count in the upper 56 bits, depth in the lower 8
+    };
+
+  public:
+   ~PerftTable() { free(); }
+
+    void free() {
+
+      aligned_large_pages_free(table);
+      table = nullptr;
+      entryCount = 0;
+    }
+
+    void resize(size_t mbSize) {
+
+      free();
+      entryCount = mbSize * 1024 * 1024 / sizeof(Entry);
+      table = static_cast<Entry*>(aligned_large_pages_alloc(entryCount * sizeof(Entry)));
+      if (!table)
+      {
+          std::cerr << "Failed to allocate " << mbSize
+                    << "MB for the perft table." << std::endl;
+          exit(EXIT_FAILURE);
+      }
+      std::memset(table, 0, entryCount * sizeof(Entry));
+    }
+
+    bool probe(Key key, Depth depth, uint64_t& nodes) const {
+
+      const Entry* e = &table[mul_hi64(key, entryCount)];
+      const uint64_t data = e->data;
+
+      if ((e->keyXorData ^ data) != key || Depth(data & 0xFF) != depth)
+          return false;
+
+      nodes = data >> 8;
+      return true;
+    }
+
+    void save(Key key, Depth depth, uint64_t nodes) {
+
+      Entry* e = &table[mul_hi64(key, entryCount)];
+      const uint64_t data = nodes << 8 | uint64_t(depth);
+      e->keyXorData = key ^ data;
+      e->data = data;
+    }
+
+  private:
+    Entry* table = nullptr;
+    size_t entryCount = 0;
+  };
+
+  PerftTable PerftHash;
+
+  // Legal root moves in generation order, the index of the next one to be
+  // counted and their leaf counts, shared by the threads.
+  std::vector<Move> perftMoves;
+  std::atomic<size_t> perftNextMove;
+  std::vector<uint64_t> perftCounts;
+
   // perft() is our utility to verify move generation. All the leaf nodes up
   // to the given depth are generated and counted, and the sum is returned.
-  template<bool Root>
   uint64_t perft(Position& pos, Depth depth) {
 
     StateInfo st;
-    uint64_t cnt, nodes = 0;
+    uint64_t nodes = 0;
     const bool leaf = (depth == 2);
 
+    if (!leaf && PerftHash.probe(pos.key(), depth, nodes))
+        return nodes;
+
     for (const auto& m : MoveList<LEGAL>(pos))
     {
-        if (Root && depth <= 1)
-            cnt = 1, nodes++;
-        else
+        pos.do_move(m, st);
+        nodes += leaf ? legal_move_count(pos) : perft(pos, depth - 1);
+        pos.undo_move(m);
+    }
+
+    if (!leaf)
+        PerftHash.save(pos.key(), depth, nodes);
+
+    return nodes;
+  }
+
+  // split_perft() is run by every thread on its copy of the root position. Each
+  // one takes the next root move not counted yet until there is none left, and
+  // returns the sum of the leaf counts of the moves it took.
+  uint64_t split_perft(Position& pos, Depth depth) {
+
+    StateInfo st;
+    uint64_t nodes = 0;
+    size_t idx;
+
+    while ((idx = perftNextMove++) < perftMoves.size())
+    {
+        const Move m = perftMoves[idx];
+        uint64_t cnt = 1;
+
+        if (depth > 1)
         {
             pos.do_move(m, st);
-            cnt = leaf ? MoveList<LEGAL>(pos).size() : perft<false>(pos, depth - 1);
-            nodes += cnt;
+            cnt = depth == 2 ? legal_move_count(pos) : perft(pos, depth - 1);
             pos.undo_move(m);
         }
-        if (Root)
-            sync_cout << UCI::move(m, pos.is_chess960()) << ": " << cnt << sync_endl;
+
+        perftCounts[idx] = cnt;
+        nodes += cnt;
     }
     return nodes;
   }
@@ -209,6 +305,52 @@ void Search::clear() {
 }
 
 
+/// SearchStats::operator+=() adds the counters of another thread
+
+Search::SearchStats& Search::SearchStats::operator+=(const SearchStats& s) {
+
+  for (int i = 0; i < CounterNb; ++i)
+      counters[i] += s.counters[i];
+
+  for (int i = 0; i < CutoffIndexNb; ++i)
+      cutoffIndex[i] += s.cutoffIndex[i];
+
+  return *this;
+}
+
+
+/// operator<<(SearchStats) prints the search statistics, with the beta cutoffs
+/// broken down by the number of the move that failed high.
+
+std::ostream& Search::operator<<(std::ostream& os, const SearchStats& s) {
+
+#if defined(USE_SEARCH_STATS)
+  const uint64_t cutoffs = std::max(s.counters[SearchStats::BetaCutoff], uint64_t(1));
+
+  os <<   "TT cutoffs        : " << s.counters[SearchStats::TTCutoff]
+     << "\nNull move cutoffs : " << s.counters[SearchStats::NullMoveCutoff]
+     << "\nFutility prunes   : " << s.counters[SearchStats::FutilityPrune]
+     << "\nLMR searches      : " << s.counters[SearchStats::LmrSearch]
+     << "\nRe-searches       : " << s.counters[SearchStats::ReSearch]
+     << "\nBeta cutoffs      : " << s.counters[SearchStats::BetaCutoff]
+     << "\nCutoff move (%)   :";
+
+  for (int i = 0; i < SearchStats::CutoffIndexNb; ++i)
+      os << " " << i + 1 << (i == SearchStats::CutoffIndexNb - 1 ? "+" : "")
+         << ": " << 100 * s.cutoffIndex[i] / cutoffs;
+
+  os << "\nNNUE evals        : " << s.counters[SearchStats::NnueEval]
+     << "\nClassical evals   : " << s.counters[SearchStats::ClassicalEval]
+     << "\nMoves generated   : " << s.counters[SearchStats::MovesGenerated];
+#else
+  (void)s;
+  os << "Search statistics are not compiled in, build with stats=yes";
+#endif
+
+  return os;
+}
+
+
 /// MainThread::search() is started when the program receives the UCI 'go'
 /// command. It searches from the root position and outputs the "bestmove".
 
@@ -216,8 +358,29 @@ void MainThread::search() {
 
   if (Limits.perft)
   {
-      nodes = perft<true>(rootPos, Limits.perft);
-      sync_cout << "\nNodes searched: " << nodes << "\n" << sync_endl;
+      PerftHash.resize(PerftHashMB);
+      perftMoves.clear();
+      for (const auto& m : MoveList<LEGAL>(rootPos))
+          perftMoves.push_back(m);
+      perftNextMove = 0;
+      perftCounts.assign(perftMoves.size(), 0);
+
+      Threads.start_searching(); // start non-main threads
+      Thread::search();          // main thread start counting
+      Threads.wait_for_search_finished();
+      PerftHash.free();
+
+      const uint64_t total = Threads.nodes_searched();
+      const TimePoint elapsed = now() - Limits.startTime + 1; // Avoid a 'divide by zero'
+      std::stringstream ss;
+
+      for (size_t i = 0; i < perftMoves.size(); ++i)
+          ss << UCI::move(perftMoves[i], rootPos.is_chess960()) << ": " << perftCounts[i] << "\n";
+
+      ss << "\nNodes searched: " << total
+         << "\nNodes/second: " << 1000 * total / elapsed << "\n";
+
+      sync_cout << ss.str() << sync_endl;
       return;
   }
 
@@ -290,6 +453,14 @@ void MainThread::search() {
 
 void Thread::search() {
 
+  // Perft splits the root moves among the threads instead of searching. The
+  // node counter then holds the leaf count of the moves taken by this thread.
+  if (Limits.perft)
+  {
+      nodes = split_perft(rootPos, Limits.perft);
+      return;
+  }
+
   // To allow access to (ss-7) up to (ss+2), the stack must be oversized.
   // The former is needed to allow update_continuation_histories(ss-1, ...),
   // which accesses its argument at ss-6, also near the root.
@@ -709,7 +880,10 @@ namespace {
         }
 
         if (pos.rule50_count() < 90)
+        {
+            thisThread->count(SearchStats::TTCutoff);
             return ttValue;
+        }
     }
 
     // Step 5. Tablebases probe
@@ -814,7 +988,10 @@ namespace {
         &&  depth < 8
         &&  eval - futility_margin(depth, improving) >= beta
         &&  eval < VALUE_KNOWN_WIN) // Do not return unproven wins
+    {
+        thisThread->count(SearchStats::FutilityPrune);
         return eval;
+    }
 
     // Step 9. Null move search with verification search (~40 Elo)
     if (   !PvNode
@@ -848,7 +1025,10 @@ namespace {
                 nullValue = beta;
 
             if (thisThread->nmpMinPly || (abs(beta) < VALUE_KNOWN_WIN && depth < 13))
+            {
+                thisThread->count(SearchStats::NullMoveCutoff);
                 return nullValue;
+            }
 
             assert(!thisThread->nmpMinPly); // Recursive verification is not allowed
 
@@ -862,7 +1042,10 @@ namespace {
             thisThread->nmpMinPly = 0;
 
             if (v >= beta)
+            {
+                thisThread->count(SearchStats::NullMoveCutoff);
                 return nullValue;
+            }
         }
     }
 
@@ -1036,7 +1219,10 @@ moves_loop: // When in check, search starts from here
                     + (*contHist[1])[movedPiece][to_sq(move)]
                     + (*contHist[3])[movedPiece][to_sq(move)]
                     + (*contHist[5])[movedPiece][to_sq(move)] / 2 < 27376)
+              {
+                  thisThread->count(SearchStats::FutilityPrune);
                   continue;
+              }
 
               // Prune moves with negative SEE (~20 Elo)
               if (!pos.see_ge(move, Value(-(29 - std::min(lmrDepth, 18)) * lmrDepth * lmrDepth)))
@@ -1149,6 +1335,8 @@ moves_loop: // When in check, search starts from here
       {
           Depth r = reduction(improving, depth, moveCount);
 
+          thisThread->count(SearchStats::LmrSearch);
+
           // Decrease reduction if the ttHit running average is large
           if (thisThread->ttHitAverage > 509 * TtHitAverageResolution * TtHitAverageWindow / 1024)
               r--;
@@ -1238,6 +1426,9 @@ moves_loop: // When in check, search starts from here
       // Step 17. Full depth search when LMR is skipped or fails high
       if (doFullDepthSearch)
       {
+          if (didLMR)
+              thisThread->count(SearchStats::ReSearch);
+
           value = -search<NonPV>(pos, ss+1, -(alpha+1), -alpha, newDepth, !cutNode);
 
           if (didLMR && !captureOrPromotion)
@@ -1260,6 +1451,9 @@ moves_loop: // When in check, search starts from here
           (ss+1)->pv = pv;
           (ss+1)->pv[0] = MOVE_NONE;
 
+          if (moveCount > 1)
+              thisThread->count(SearchStats::ReSearch);
+
           value = -search<PV>(pos, ss+1, -beta, -alpha,
                               std::min(maxNextDepth, newDepth), false);
       }
@@ -1323,6 +1517,8 @@ moves_loop: // When in check, search starts from here
               {
                   assert(value >= beta); // Fail high
                   ss->statScore = 0;
+                  thisThread->count(SearchStats::BetaCutoff);
+                  thisThread->count_cutoff(moveCount);
                   break;
               }
           }
@@ -1449,7 +1645,10 @@ moves_loop: // When in check, search starts from here
         && ttValue != VALUE_NONE // Only in case of TT access race
         && (ttValue >= beta ? (tte->bound() & BOUND_LOWER)
                             : (tte->bound() & BOUND_UPPER)))
+    {
+        thisThread->count(SearchStats::TTCutoff);
         return ttValue;
+    }
 
     // Evaluate the position statically
     if (ss->inCheck)
@@ -1531,12 +1730,14 @@ moves_loop: // When in check, search starts from here
           if (futilityValue <= alpha)
           {
               bestValue = std::max(bestValue, futilityValue);
+              thisThread->count(SearchStats::FutilityPrune);
               continue;
           }
 
           if (futilityBase <= alpha && !pos.see_ge(move, VALUE_ZERO + 1))
           {
               bestValue = std::max(bestValue, futilityBase);
+              thisThread->count(SearchStats::FutilityPrune);
               continue;
           }
       }
@@ -1882,6 +2083,12 @@ string UCI::pv(const Position& pos, Depth depth, Value alpha, Value beta) {
           ss << " " << UCI::move(m, pos.is_chess960());
   }
 
+  // Tablebase probe cache statistics, next to the tbhits of the lines above
+  uint64_t cacheHits = Threads.tb_cache_hits(), cacheMisses = Threads.tb_cache_misses();
+
+  if (cacheHits + cacheMisses)
+      ss << "\ninfo string tbcache hits " << cacheHits << " misses " << cacheMisses;
+
   return ss.str();
 }
 
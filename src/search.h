@@ -19,6 +19,7 @@
 #ifndef SEARCH_H_INCLUDED
 #define SEARCH_H_INCLUDED
 
+#include <ostream>
 #include <vector>
 
 #include "misc.h"
@@ -53,6 +54,31 @@ struct Stack {
 };
 
 
+/// SearchStats counts events of the search of one thread, such as cutoffs and
+/// prunings, for the 'stats' command and the bench report. The counters are
+/// updated only when compiled with USE_SEARCH_STATS (make stats=yes), and
+/// each thread updates its own, so they are summed across threads on report.
+
+struct SearchStats {
+
+  enum Counter {
+    TTCutoff, NullMoveCutoff, FutilityPrune, LmrSearch, ReSearch,
+    BetaCutoff, NnueEval, ClassicalEval, MovesGenerated, CounterNb
+  };
+
+  // Beta cutoffs by the number of the move that failed high, 8 or more
+  // moves in the last slot.
+  static constexpr int CutoffIndexNb = 8;
+
+  SearchStats& operator+=(const SearchStats& s);
+
+  uint64_t counters[CounterNb] = {};
+  uint64_t cutoffIndex[CutoffIndexNb] = {};
+};
+
+std::ostream& operator<<(std::ostream& os, const SearchStats& s);
+
+
 /// RootMove struct is used for moves at the root of the tree. For each root move
 /// we store a score and a PV (really a refutation in the case of moves which
 /// fail low). Score is normally set at -VALUE_INFINITE for all non-pv moves.
@@ -71,6 +97,7 @@ struct RootMove {
   Value previousScore = -VALUE_INFINITE;
   int selDepth = 0;
   int tbRank = 0;
+  int tbDTZ = 0;
   Value tbScore;
   std::vector<Move> pv;
 };
@@ -19,29 +19,32 @@
 #include <algorithm>
 #include <atomic>
 #include <cstdint>
+#include <cstdio>    // For std::remove and std::rename
 #include <cstring>   // For std::memset and std::memcpy
 #include <deque>
 #include <fstream>
 #include <iostream>
 #include <list>
 #include <sstream>
+#include <thread>
 #include <type_traits>
-#include <mutex>
 
 #include "../bitboard.h"
 #include "../movegen.h"
 #include "../position.h"
 #include "../search.h"
+#include "../thread.h"
 #include "../types.h"
 #include "../uci.h"
 
 #include "tbprobe.h"
 
+#include <sys/stat.h>
+
 #ifndef _WIN32
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/mman.h>
-#include <sys/stat.h>
 #else
 #define WIN32_LEAN_AND_MEAN
 #ifndef NOMINMAX
@@ -58,6 +61,12 @@ namespace {
 
 constexpr int TBPIECES = 7; // Max number of supported pieces
 
+#ifndef _WIN32
+constexpr char SepChar = ':'; // Separator of the SyzygyPath directories
+#else
+constexpr char SepChar = ';';
+#endif
+
 enum { BigEndian, LittleEndian };
 enum TBType { WDL, DTZ }; // Used as template parameter
 
@@ -182,11 +191,6 @@ public:
 
     TBFile(const std::string& f) {
 
-#ifndef _WIN32
-        constexpr char SepChar = ':';
-#else
-        constexpr char SepChar = ';';
-#endif
         std::stringstream ss(Paths);
         std::string path;
 
@@ -200,7 +204,7 @@ public:
 
     // Memory map the file and check it. File should be already open and will be
     // closed after mapping.
-    uint8_t* map(void** baseAddress, uint64_t* mapping, TBType type) {
+    uint8_t* map(void** baseAddress, uint64_t* mapping, uint64_t* size, TBType type) {
 
         assert(is_open());
 
@@ -221,7 +225,7 @@ public:
             exit(EXIT_FAILURE);
         }
 
-        *mapping = statbuf.st_size;
+        *mapping = *size = statbuf.st_size;
         *baseAddress = mmap(nullptr, statbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
 #if defined(MADV_RANDOM)
         madvise(*baseAddress, statbuf.st_size, MADV_RANDOM);
@@ -260,6 +264,7 @@ public:
         }
 
         *mapping = (uint64_t)mmap;
+        *size = (uint64_t(size_high) << 32) | size_low;
         *baseAddress = MapViewOfFile(mmap, FILE_MAP_READ, 0, 0, 0);
 
         if (!*baseAddress)
@@ -325,17 +330,21 @@ struct PairsData {
 // struct TBTable contains indexing information to access the corresponding TBFile.
 // There are 2 types of TBTable, corresponding to a WDL or a DTZ file. TBTable
 // is populated at init time but the nested PairsData records are populated at
-// first access, when the corresponding file is memory mapped.
+// first access, when the corresponding file is memory mapped. The state field
+// tracks the mapping, see mapped().
+enum TBState : uint8_t { Unmapped, Mapping, Ready };
+
 template<TBType Type>
 struct TBTable {
     typedef typename std::conditional<Type == WDL, WDLScore, int>::type Ret;
 
     static constexpr int Sides = Type == WDL ? 2 : 1;
 
-    std::atomic_bool ready;
+    std::atomic<TBState> state;
     void* baseAddress;
     uint8_t* map;
     uint64_t mapping;
+    uint64_t size;
     Key key;
     Key key2;
     int pieceCount;
@@ -348,7 +357,7 @@ struct TBTable {
         return &items[stm % Sides][hasPawns ? f : 0];
     }
 
-    TBTable() : ready(false), baseAddress(nullptr) {}
+    TBTable() : state(Unmapped), baseAddress(nullptr), size(0) {}
     explicit TBTable(const std::string& code);
     explicit TBTable(const TBTable<WDL>& wdl);
 
@@ -423,6 +432,7 @@ class TBTables {
 
     std::deque<TBTable<WDL>> wdlTable;
     std::deque<TBTable<DTZ>> dtzTable;
+    std::vector<std::string> codes; // Like "KRvK", in the order of the tables
 
     void insert(Key key, TBTable<WDL>* wdl, TBTable<DTZ>* dtz) {
         uint32_t homeBucket = (uint32_t)key & (Size - 1);
@@ -462,33 +472,84 @@ public:
         memset(hashTable, 0, sizeof(hashTable));
         wdlTable.clear();
         dtzTable.clear();
+        codes.clear();
     }
     size_t size() const { return wdlTable.size(); }
-    void add(const std::vector<PieceType>& pieces);
+    void add(const std::string& code);
+    void warm(int maxPieces, uint64_t budget, uint64_t* mapped, uint64_t* preloaded);
 };
 
 TBTables TBTables;
 
-// If the corresponding file exists two new objects TBTable<WDL> and TBTable<DTZ>
-// are created and added to the lists and hash table. Called at init time.
-void TBTables::add(const std::vector<PieceType>& pieces) {
+// class ProbeCache keeps the results of probe_wdl() and probe_dtz() for the
+// positions probed most recently, shared by all threads and indexed by the
+// position key. Each entry stores the result in one 64 bit word and the full
+// key xor-ed with it in another, like the perft table does, so a hit verifies
+// all the key bits without any lock and an entry torn by concurrent writes
+// does not verify.
+class ProbeCache {
 
-    std::string code;
+    struct Entry {
+        std::atomic<uint64_t> keyXorData, data;
+    };
 
-    for (PieceType pt : pieces)
-        code += PieceToChar[pt];
+    static constexpr int Size = 1 << 16; // 1 MB, WDL and DTZ in adjacent entries
 
-    TBFile file(code.insert(code.find('K', 1), "v") + ".rtbw"); // KRK -> KRvK
+    Entry table[Size];
 
-    if (!file.is_open()) // Only WDL file is checked
-        return;
+    static size_t index(Key key, TBType type) { return ((size_t(key) << 1) | type) & (Size - 1); }
 
-    file.close();
+public:
+    bool probe(Key key, TBType type, int* value, ProbeState* state) const {
+
+        const Entry& e = table[index(key, type)];
+        uint64_t data = e.data.load(std::memory_order_relaxed);
+
+        if ((e.keyXorData.load(std::memory_order_relaxed) ^ data) != key || !data) // Mismatch or empty
+            return false;
+
+        *value = int16_t(data);
+        *state = ProbeState(int((data >> 16) & 0xFF) - 2);
+        return true;
+    }
 
-    MaxCardinality = std::max((int)pieces.size(), MaxCardinality);
+    void store(Key key, TBType type, int value, ProbeState state) {
+
+        Entry& e = table[index(key, type)];
+        uint64_t data =  uint64_t(uint8_t(state + 2)) << 16 // Never zero, marks a valid entry
+                       | uint16_t(value);
+
+        e.keyXorData.store(key ^ data, std::memory_order_relaxed);
+        e.data.store(data, std::memory_order_relaxed);
+    }
+
+    void clear() {
+        for (Entry& e : table)
+            e.keyXorData.store(0, std::memory_order_relaxed), e.data.store(0, std::memory_order_relaxed);
+    }
+};
+
+ProbeCache ProbeCache;
+
+// Count probe cache hits and misses for the 'tbcache' line of the search info
+void count_cache(const Position& pos, bool hit) {
+
+    if (Thread* th = pos.this_thread())
+        (hit ? th->tbCacheHits : th->tbCacheMisses).fetch_add(1, std::memory_order_relaxed);
+}
+
+int probe_dtz_table(Position& pos, ProbeState* result);
+
+// Two new objects TBTable<WDL> and TBTable<DTZ> are created for the table 'code',
+// like "KRvK", whose file has been found, and added to the lists and hash table.
+// Called at init time.
+void TBTables::add(const std::string& code) {
+
+    MaxCardinality = std::max(int(code.size()) - 1, MaxCardinality);
 
     wdlTable.emplace_back(code);
     dtzTable.emplace_back(wdlTable.back());
+    codes.push_back(code);
 
     // Insert into the hash keys for both colors: KRvK with KR white and black
     insert(wdlTable.back().key , &wdlTable.back(), &dtzTable.back());
@@ -1130,21 +1191,26 @@ void set(T& e, uint8_t* data) {
 // If the TB file corresponding to the given position is already memory mapped
 // then return its base address, otherwise try to memory map and init it. Called
 // at every probe, memory map and init only at first access. Function is thread
-// safe and can be called concurrently.
+// safe and can be called concurrently: the first thread to switch the table
+// from Unmapped to Mapping does the work while other threads probing the same
+// table wait for it, and tables are mapped in parallel with each other.
 template<TBType Type>
 void* mapped(TBTable<Type>& e, const Position& pos) {
 
-    static std::mutex mutex;
+    // Use 'acquire' to avoid a thread reading 'Ready' while another is still
+    // working. (compiler reordering may cause this).
+    TBState s = e.state.load(std::memory_order_acquire);
 
-    // Use 'acquire' to avoid a thread reading 'ready' == true while
-    // another is still working. (compiler reordering may cause this).
-    if (e.ready.load(std::memory_order_acquire))
+    if (s == Ready)
         return e.baseAddress; // Could be nullptr if file does not exist
 
-    std::unique_lock<std::mutex> lk(mutex);
+    if (s == Mapping || !e.state.compare_exchange_strong(s, Mapping, std::memory_order_acquire))
+    {
+        while (e.state.load(std::memory_order_acquire) != Ready)
+            std::this_thread::yield();
 
-    if (e.ready.load(std::memory_order_relaxed)) // Recheck under lock
         return e.baseAddress;
+    }
 
     // Pieces strings in decreasing order for each color, like ("KPP","KR")
     std::string fname, w, b;
@@ -1156,15 +1222,76 @@ void* mapped(TBTable<Type>& e, const Position& pos) {
     fname =  (e.key == pos.material_key() ? w + 'v' + b : b + 'v' + w)
            + (Type == WDL ? ".rtbw" : ".rtbz");
 
-    uint8_t* data = TBFile(fname).map(&e.baseAddress, &e.mapping, Type);
+    uint8_t* data = TBFile(fname).map(&e.baseAddress, &e.mapping, &e.size, Type);
 
     if (data)
         set(e, data);
 
-    e.ready.store(true, std::memory_order_release);
+    e.state.store(Ready, std::memory_order_release);
     return e.baseAddress;
 }
 
+// Ask the OS to read ahead the given range of a mapped file, or touch one byte
+// per page where madvise() is not available.
+void preload(const void* addr, uint64_t len) {
+
+#if !defined(_WIN32) && defined(MADV_WILLNEED)
+    uintptr_t start = uintptr_t(addr) & ~uintptr_t(4095); // madvise() wants page alignment
+    madvise((void*)start, len + (uintptr_t(addr) - start), MADV_WILLNEED);
+#else
+    volatile uint8_t sum = 0;
+    for (uint64_t i = 0; i < len; i += 4096)
+        sum += ((const volatile uint8_t*)addr)[i];
+#endif
+}
+
+// TBTables::warm() maps all the tables, using all the hardware threads, and
+// requests the WDL files to be read ahead until budget bytes are requested.
+// The mapped and preloaded byte counts are returned through the pointers.
+void TBTables::warm(int maxPieces, uint64_t budget, uint64_t* mappedBytes, uint64_t* preloadedBytes) {
+
+    std::atomic<size_t> next(0);
+    std::atomic<uint64_t> mappedSum(0), requested(0);
+    std::vector<std::thread> workers;
+
+    auto worker = [&]() {
+
+        StateInfo st;
+        Position pos;
+
+        for (size_t i = next++; i < codes.size(); i = next++)
+        {
+            if (wdlTable[i].pieceCount > maxPieces) // Never probed
+                continue;
+
+            pos.set(codes[i], WHITE, &st);
+
+            if (mapped(wdlTable[i], pos))
+            {
+                mappedSum += wdlTable[i].size;
+
+                uint64_t before = requested.fetch_add(wdlTable[i].size);
+                if (before < budget)
+                    preload(wdlTable[i].baseAddress, std::min(wdlTable[i].size, budget - before));
+            }
+
+            if (mapped(dtzTable[i], pos))
+                mappedSum += dtzTable[i].size;
+        }
+    };
+
+    size_t n = std::max(std::thread::hardware_concurrency(), 1U);
+
+    for (size_t i = 0; i < n; ++i)
+        workers.emplace_back(worker);
+
+    for (std::thread& th : workers)
+        th.join();
+
+    *mappedBytes = mappedSum;
+    *preloadedBytes = std::min(uint64_t(requested), budget);
+}
+
 template<TBType Type, typename Ret = typename TBTable<Type>::Ret>
 Ret probe_table(const Position& pos, ProbeState* result, WDLScore wdl = WDLDraw) {
 
@@ -1257,12 +1384,138 @@ WDLScore search(Position& pos, ProbeState* result) {
 } // namespace
 
 
+namespace {
+
+// find_files() checks which of the candidate tables have a WDL file among the
+// Paths directories, spreading the checks over a pool of threads because on a
+// network file system each one waits for a round trip. The found tables are
+// returned in the order of the candidates.
+std::vector<std::string> find_files(const std::vector<std::string>& candidates) {
+
+    std::vector<char> exists(candidates.size(), false);
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> workers;
+
+    auto worker = [&]() {
+        for (size_t i = next++; i < candidates.size(); i = next++)
+            exists[i] = TBFile(candidates[i] + ".rtbw").is_open(); // Only WDL file is checked
+    };
+
+    size_t n = std::min(size_t(std::max(std::thread::hardware_concurrency(), 1U)), candidates.size());
+
+    for (size_t i = 0; i < n; ++i)
+        workers.emplace_back(worker);
+
+    for (std::thread& th : workers)
+        th.join();
+
+    std::vector<std::string> found;
+
+    for (size_t i = 0; i < candidates.size(); ++i)
+        if (exists[i])
+            found.push_back(candidates[i]);
+
+    return found;
+}
+
+// dir_stamp() returns the modification time of every directory in Paths, one
+// "dir <mtime> <path>" line each, or an empty string if any of them can not be
+// read. Adding, removing or renaming a file changes the time of its directory,
+// so an unchanged stamp means an unchanged set of tables.
+std::string dir_stamp(const std::string& paths) {
+
+    std::stringstream ss(paths), stamp;
+    std::string path;
+
+    while (std::getline(ss, path, SepChar))
+    {
+        struct stat statbuf;
+
+        if (stat(path.c_str(), &statbuf))
+            return std::string();
+
+        stamp << "dir " << uint64_t(statbuf.st_mtime) << " " << path << "\n";
+    }
+
+    return stamp.str();
+}
+
+// read_index() loads the tables found by a previous init() from the index file,
+// if its stamp matches. The file is accepted only if it lists exactly the number
+// of tables in its "tables" line followed by the "end" line, and only codes of
+// candidate tables, otherwise it is damaged and ignored.
+bool read_index(const std::string& fname, const std::string& stamp,
+                const std::vector<std::string>& candidates, std::vector<std::string>& found) {
+
+    std::ifstream file(fname);
+    std::string line, fileStamp, token;
+    size_t count;
+
+    while (std::getline(file, line) && !line.empty())
+        fileStamp += line + "\n";
+
+    if (   !file || fileStamp != stamp
+        || !std::getline(file, line)
+        || !(std::istringstream(line) >> token >> count) || token != "tables")
+        return false;
+
+    std::vector<std::string> sorted(candidates);
+    std::sort(sorted.begin(), sorted.end());
+
+    while (found.size() < count && std::getline(file, line))
+        if (std::binary_search(sorted.begin(), sorted.end(), line))
+            found.push_back(line);
+        else
+            break;
+
+    if (found.size() != count || !std::getline(file, line) || line != "end")
+        return found.clear(), false;
+
+    return true;
+}
+
+// write_index() saves the stamp and the found tables to the index file. The
+// file is written under a temporary name and renamed into place, so that other
+// engines starting at the same time read either the old or the new index. A
+// file that can not be written is not an error, the directories are scanned
+// again at next init() instead.
+void write_index(const std::string& fname, const std::string& stamp,
+                 const std::vector<std::string>& found) {
+
+#ifndef _WIN32
+    std::string tmpName = fname + ".tmp" + std::to_string(getpid());
+#else
+    std::string tmpName = fname + ".tmp" + std::to_string(GetCurrentProcessId());
+#endif
+
+    std::ofstream file(tmpName, std::ios::trunc);
+
+    file << stamp << "\ntables " << found.size() << "\n";
+
+    for (const std::string& code : found)
+        file << code << "\n";
+
+    file << "end" << std::endl;
+    file.close();
+
+#ifndef _WIN32
+    if (!file || std::rename(tmpName.c_str(), fname.c_str()))
+#else
+    if (!file || !MoveFileExA(tmpName.c_str(), fname.c_str(), MOVEFILE_REPLACE_EXISTING))
+#endif
+        std::remove(tmpName.c_str());
+}
+
+} // namespace
+
+
 /// Tablebases::init() is called at startup and after every change to
 /// "SyzygyPath" UCI option to (re)create the various tables. It is not thread
 /// safe, nor it needs to be.
 void Tablebases::init(const std::string& paths) {
 
     TBTables.clear();
+    ProbeCache.clear();
     MaxCardinality = 0;
     TBFile::Paths = paths;
 
@@ -1363,45 +1616,99 @@ void Tablebases::init(const std::string& paths) {
             LeadPawnsSize[leadPawnsCnt][f] = idx;
         }
 
-    // Add entries in TB tables if the corresponding ".rtbw" file exists
+    // Collect the candidate tables, like "KRvK", for all the material combinations
+    std::vector<std::string> candidates;
+
+    auto add = [&](const std::vector<PieceType>& pieces) {
+        std::string name;
+
+        for (PieceType pt : pieces)
+            name += PieceToChar[pt];
+
+        candidates.push_back(name.insert(name.find('K', 1), "v")); // KRK -> KRvK
+    };
+
     for (PieceType p1 = PAWN; p1 < KING; ++p1) {
-        TBTables.add({KING, p1, KING});
+        add({KING, p1, KING});
 
         for (PieceType p2 = PAWN; p2 <= p1; ++p2) {
-            TBTables.add({KING, p1, p2, KING});
-            TBTables.add({KING, p1, KING, p2});
+            add({KING, p1, p2, KING});
+            add({KING, p1, KING, p2});
 
             for (PieceType p3 = PAWN; p3 < KING; ++p3)
-                TBTables.add({KING, p1, p2, KING, p3});
+                add({KING, p1, p2, KING, p3});
 
             for (PieceType p3 = PAWN; p3 <= p2; ++p3) {
-                TBTables.add({KING, p1, p2, p3, KING});
+                add({KING, p1, p2, p3, KING});
 
                 for (PieceType p4 = PAWN; p4 <= p3; ++p4) {
-                    TBTables.add({KING, p1, p2, p3, p4, KING});
+                    add({KING, p1, p2, p3, p4, KING});
 
                     for (PieceType p5 = PAWN; p5 <= p4; ++p5)
-                        TBTables.add({KING, p1, p2, p3, p4, p5, KING});
+                        add({KING, p1, p2, p3, p4, p5, KING});
 
                     for (PieceType p5 = PAWN; p5 < KING; ++p5)
-                        TBTables.add({KING, p1, p2, p3, p4, KING, p5});
+                        add({KING, p1, p2, p3, p4, KING, p5});
                 }
 
                 for (PieceType p4 = PAWN; p4 < KING; ++p4) {
-                    TBTables.add({KING, p1, p2, p3, KING, p4});
+                    add({KING, p1, p2, p3, KING, p4});
 
                     for (PieceType p5 = PAWN; p5 <= p4; ++p5)
-                        TBTables.add({KING, p1, p2, p3, KING, p4, p5});
+                        add({KING, p1, p2, p3, KING, p4, p5});
                 }
             }
 
             for (PieceType p3 = PAWN; p3 <= p1; ++p3)
                 for (PieceType p4 = PAWN; p4 <= (p1 == p3 ? p2 : p3); ++p4)
-                    TBTables.add({KING, p1, p2, KING, p3, p4});
+                    add({KING, p1, p2, KING, p3, p4});
         }
     }
 
+    // Add entries in TB tables if the corresponding ".rtbw" file exists, as
+    // listed by the index file when the directories have not changed since.
+    std::string indexFile = Options["SyzygyIndexFile"];
+    std::string stamp = dir_stamp(paths);
+    std::vector<std::string> found;
+    bool useIndex = !indexFile.empty() && indexFile != "<empty>" && !stamp.empty();
+
+    if (!useIndex || !read_index(indexFile, stamp, candidates, found))
+    {
+        found = find_files(candidates);
+
+        if (useIndex)
+            write_index(indexFile, stamp, found);
+    }
+
+    for (const std::string& name : found)
+        TBTables.add(name);
+
     sync_cout << "info string Found " << TBTables.size() << " tablebases" << sync_endl;
+
+    if (int(Options["SyzygyPreload"]))
+        warm(size_t(Options["SyzygyPreload"]));
+}
+
+
+/// Tablebases::warm() maps in parallel the tables found by init() that are
+/// within "SyzygyProbeLimit", and preloads up to budgetMB megabytes of their
+/// WDL files in the page cache, so that the first probes in the search do not
+/// wait for the disk. Larger tables are never probed and stay unmapped.
+
+void Tablebases::warm(size_t budgetMB) {
+
+    if (!TBTables.size())
+        return;
+
+    uint64_t mappedBytes, preloadedBytes;
+    TimePoint elapsed = now();
+
+    TBTables.warm(int(Options["SyzygyProbeLimit"]), uint64_t(budgetMB) << 20, &mappedBytes, &preloadedBytes);
+
+    elapsed = now() - elapsed;
+
+    sync_cout << "info string Mapped " << (mappedBytes >> 20) << " MB of tablebases, preloaded "
+              << (preloadedBytes >> 20) << " MB of WDL files in " << elapsed << " ms" << sync_endl;
 }
 
 // Probe the WDL table for a particular position.
@@ -1414,8 +1721,23 @@ void Tablebases::init(const std::string& paths) {
 //  2 : win
 WDLScore Tablebases::probe_wdl(Position& pos, ProbeState* result) {
 
+    int v;
+
+    if (ProbeCache.probe(pos.key(), WDL, &v, result))
+    {
+        count_cache(pos, true);
+        return WDLScore(v);
+    }
+
+    count_cache(pos, false);
+
     *result = OK;
-    return search<false>(pos, result);
+    WDLScore wdl = search<false>(pos, result);
+
+    if (*result != FAIL)
+        ProbeCache.store(pos.key(), WDL, wdl, *result);
+
+    return wdl;
 }
 
 // Probe the DTZ table for a particular position.
@@ -1446,6 +1768,29 @@ WDLScore Tablebases::probe_wdl(Position& pos, ProbeState* result) {
 // then do not accept moves leading to dtz + 50-move-counter == 100.
 int Tablebases::probe_dtz(Position& pos, ProbeState* result) {
 
+    int dtz;
+
+    if (ProbeCache.probe(pos.key(), DTZ, &dtz, result))
+    {
+        count_cache(pos, true);
+        return dtz;
+    }
+
+    count_cache(pos, false);
+
+    dtz = probe_dtz_table(pos, result);
+
+    if (*result != FAIL)
+        ProbeCache.store(pos.key(), DTZ, dtz, *result);
+
+    return dtz;
+}
+
+namespace {
+
+// probe_dtz_table() does the actual DTZ probe for probe_dtz()
+int probe_dtz_table(Position& pos, ProbeState* result) {
+
     *result = OK;
     WDLScore wdl = search<true>(pos, result);
 
@@ -1506,6 +1851,8 @@ int Tablebases::probe_dtz(Position& pos, ProbeState* result) {
     return minDTZ == 0xFFFF ? -1 : minDTZ;
 }
 
+} // namespace
+
 
 // Use the DTZ tables to rank root moves.
 //
@@ -1560,6 +1907,7 @@ bool Tablebases::root_probe(Position& pos, Search::RootMoves& rootMoves) {
                : dtz < 0 ? (-dtz * 2 + cnt50 < 100 ? -1000 : -1000 + (-dtz + cnt50))
                : 0;
         m.tbRank = r;
+        m.tbDTZ = dtz;
 
         // Determine the score to be displayed for this move. Assign at least
         // 1 cp to cursed wins and let it grow to 49 cp as the positions gets
@@ -19,6 +19,7 @@
 #include <cassert>
 
 #include <algorithm> // For std::count
+#include "evaluate.h"
 #include "movegen.h"
 #include "search.h"
 #include "thread.h"
@@ -59,6 +60,7 @@ void Thread::clear() {
   mainHistory.fill(0);
   lowPlyHistory.fill(0);
   captureHistory.fill(0);
+  accumulatorCache.clear();
 
   for (bool inCheck : { false, true })
       for (StatsType c : { NoCaptures, Captures })
@@ -81,6 +83,19 @@ void Thread::start_searching() {
 }
 
 
+/// Thread::start_task() wakes up the thread to run f instead of a search, so
+/// that memory f touches first is placed on the node of the thread. Use
+/// wait_for_search_finished() to wait for f to complete.
+
+void Thread::start_task(std::function<void()> f) {
+
+  std::lock_guard<std::mutex> lk(mutex);
+  task = std::move(f);
+  searching = true;
+  cv.notify_one(); // Wake up the thread in idle_loop()
+}
+
+
 /// Thread::wait_for_search_finished() blocks on the condition variable
 /// until the thread has finished searching.
 
@@ -102,7 +117,17 @@ void Thread::idle_loop() {
   // just check if running threads are below a threshold, in this case all this
   // NUMA machinery is not needed.
   if (Options["Threads"] > 8)
+  {
       WinProcGroup::bindThisThread(idx);
+      numaNode = WinProcGroup::node(idx);
+  }
+
+  // Once bound, allocate and touch the pawn and material tables from this
+  // thread, so that with a first-touch policy their memory lives on the local
+  // node. Histories are first touched by ThreadPool::clear(), which hands the
+  // clear to each thread through start_task().
+  pawnsTable.resize(size_t(Options["Pawn Hash"]));
+  materialTable.resize(size_t(Options["Material Hash"]));
 
   while (true)
   {
@@ -116,7 +141,10 @@ void Thread::idle_loop() {
 
       lk.unlock();
 
-      search();
+      if (task)
+          task(), task = nullptr;
+      else
+          search();
   }
 }
 
@@ -140,6 +168,12 @@ void ThreadPool::set(size_t requested) {
           push_back(new Thread(size()));
       clear();
 
+      if (requested > 8 && !WinProcGroup::topology(requested).empty())
+          sync_cout << "info string " << WinProcGroup::topology(requested) << sync_endl;
+
+      // Threads may have moved to other nodes
+      Eval::NNUE::replicate();
+
       // Reallocate the hash with the new threadpool size
       TT.resize(size_t(Options["Hash"]));
 
@@ -149,12 +183,49 @@ void ThreadPool::set(size_t requested) {
 }
 
 
+/// ThreadPool::resize_eval_tables() resizes the pawn and material tables of
+/// all the threads after a change of the "Pawn Hash" or "Material Hash" options.
+/// Each thread reallocates its own tables, keeping them on its node. Threads
+/// and the transposition table are left untouched.
+
+void ThreadPool::resize_eval_tables() {
+
+  main()->wait_for_search_finished();
+
+  for (Thread* th : *this)
+      th->start_task([th]{
+          th->pawnsTable.resize(size_t(Options["Pawn Hash"]));
+          th->materialTable.resize(size_t(Options["Material Hash"]));
+      });
+
+  for (Thread* th : *this)
+      th->wait_for_search_finished();
+}
+
+
+/// ThreadPool::search_stats() sums the search statistics of all the threads
+
+Search::SearchStats ThreadPool::search_stats() const {
+
+  Search::SearchStats s = Search::SearchStats();
+
+  for (Thread* th : *this)
+      s += th->stats;
+
+  return s;
+}
+
+
 /// ThreadPool::clear() sets threadPool data to initial values
 
 void ThreadPool::clear() {
 
+  // Each thread clears its own histories and accumulators
+  for (Thread* th : *this)
+      th->start_task([th]{ th->clear(); });
+
   for (Thread* th : *this)
-      th->clear();
+      th->wait_for_search_finished();
 
   main()->callsCnt = 0;
   main()->bestPreviousScore = VALUE_INFINITE;
@@ -198,11 +269,16 @@ void ThreadPool::start_thinking(Position& pos, StateListPtr& states,
   // since they are read-only.
   for (Thread* th : *this)
   {
-      th->nodes = th->tbHits = th->nmpMinPly = th->bestMoveChanges = 0;
+      th->nodes = th->tbHits = th->tbCacheHits = th->tbCacheMisses = th->ttCollisions = 0;
+      th->nmpMinPly = th->bestMoveChanges = 0;
+      th->stats = Search::SearchStats();
       th->rootDepth = th->completedDepth = 0;
       th->rootMoves = rootMoves;
       th->rootPos.set(pos.fen(), pos.is_chess960(), &th->rootState, th);
       th->rootState = setupStates->back();
+      th->rootState.accumulatorState[WHITE] = Eval::NNUE::INIT;
+      th->rootState.accumulatorState[BLACK] = Eval::NNUE::INIT;
+      th->rootState.accumulatorIdx = 0;
   }
 
   main()->start_searching();
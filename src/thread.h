@@ -19,8 +19,10 @@
 #ifndef THREAD_H_INCLUDED
 #define THREAD_H_INCLUDED
 
+#include <algorithm>
 #include <atomic>
 #include <condition_variable>
+#include <functional>
 #include <mutex>
 #include <thread>
 #include <vector>
@@ -44,7 +46,7 @@ class Thread {
   std::condition_variable cv;
   size_t idx;
   bool exit = false, searching = true; // Set before starting std::thread
-  NativeThread stdThread;
+  std::function<void()> task;          // Run by idle_loop() instead of search()
 
 public:
   explicit Thread(size_t);
@@ -53,15 +55,28 @@ public:
   void clear();
   void idle_loop();
   void start_searching();
+  void start_task(std::function<void()> f);
   void wait_for_search_finished();
 
+#if defined(USE_SEARCH_STATS)
+  void count(Search::SearchStats::Counter c, uint64_t n = 1) { stats.counters[c] += n; }
+  void count_cutoff(int moveCount) {
+    stats.cutoffIndex[std::min(moveCount, Search::SearchStats::CutoffIndexNb) - 1]++;
+  }
+#else
+  void count(Search::SearchStats::Counter, uint64_t = 1) {}
+  void count_cutoff(int) {}
+#endif
+
   Pawns::Table pawnsTable;
   Material::Table materialTable;
   size_t pvIdx, pvLast;
+  int numaNode = -1; // See WinProcGroup::node()
   uint64_t ttHitAverage;
   int selDepth, nmpMinPly;
   Color nmpColor;
-  std::atomic<uint64_t> nodes, tbHits, bestMoveChanges;
+  std::atomic<uint64_t> nodes, tbHits, tbCacheHits, tbCacheMisses, ttCollisions, bestMoveChanges;
+  Search::SearchStats stats;
 
   Position rootPos;
   StateInfo rootState;
@@ -72,8 +87,14 @@ public:
   LowPlyHistory lowPlyHistory;
   CapturePieceToHistory captureHistory;
   ContinuationHistory continuationHistory[2][2];
+  Eval::NNUE::AccumulatorCache accumulatorCache;
+  Eval::NNUE::Accumulator accumulators[MAX_PLY + 1];
   Score contempt;
   int failedHighCnt;
+
+private:
+  // Declared last, so that idle_loop() can use all the members above
+  NativeThread stdThread;
 };
 
 
@@ -104,10 +125,15 @@ struct ThreadPool : public std::vector<Thread*> {
   void start_thinking(Position&, StateListPtr&, const Search::LimitsType&, bool = false);
   void clear();
   void set(size_t);
+  void resize_eval_tables();
 
   MainThread* main()        const { return static_cast<MainThread*>(front()); }
   uint64_t nodes_searched() const { return accumulate(&Thread::nodes); }
   uint64_t tb_hits()        const { return accumulate(&Thread::tbHits); }
+  uint64_t tb_cache_hits()  const { return accumulate(&Thread::tbCacheHits); }
+  uint64_t tb_cache_misses() const { return accumulate(&Thread::tbCacheMisses); }
+  uint64_t tt_collisions()  const { return accumulate(&Thread::ttCollisions); }
+  Search::SearchStats search_stats() const;
   Thread* get_best_thread() const;
   void start_searching();
   void wait_for_search_finished() const;
@@ -17,10 +17,12 @@
 */
 
 #include <cstring>   // For std::memset
+#include <fstream>
 #include <iostream>
 #include <thread>
 
 #include "bitboard.h"
+#include "evaluate.h"
 #include "misc.h"
 #include "thread.h"
 #include "tt.h"
@@ -28,29 +30,54 @@
 
 TranspositionTable TT; // Our global transposition table
 
+namespace {
+
+  // Magic number at the start of a transposition table snapshot file
+  constexpr uint32_t SnapshotMagic = 0x54545346; // "SFTT"
+
+  // signature() identifies the engine build and the evaluation in use. A
+  // snapshot is only accepted by the same binary running the same network,
+  // so that stored moves and static evaluations remain meaningful.
+  std::string signature() {
+
+    std::string sig = engine_info() + ", " + (Eval::useNNUE ? Eval::eval_file_loaded : "classical");
+#if defined(USE_LOCKLESS_TT)
+    sig += ", lockless"; // Stored keys are xored with the entry data
+#endif
+    return sig;
+  }
+}
+
 /// TTEntry::save() populates the TTEntry with a new node's data, possibly
 /// overwriting an old position. Update is not atomic and can be racy.
 
 void TTEntry::save(Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev) {
 
+  const uint16_t k16 = (uint16_t)k, oldKey = key();
+
   // Preserve any existing move for the same position
-  if (m || (uint16_t)k != key16)
+  if (m || k16 != oldKey)
       move16 = (uint16_t)m;
 
   // Overwrite less valuable entries (cheapest checks first)
   if (b == BOUND_EXACT
-      || (uint16_t)k != key16
+      || k16 != oldKey
       || d - DEPTH_OFFSET > depth8 - 4)
   {
       assert(d > DEPTH_OFFSET);
       assert(d < 256 + DEPTH_OFFSET);
 
-      key16     = (uint16_t)k;
+      key16     = k16;
       depth8    = (uint8_t)(d - DEPTH_OFFSET);
       genBound8 = (uint8_t)(TT.generation8 | uint8_t(pv) << 2 | b);
       value16   = (int16_t)v;
       eval16    = (int16_t)ev;
   }
+
+#if defined(USE_LOCKLESS_TT)
+  // Bind the stored key to the (possibly only partially updated) data
+  key16 = k16 ^ checksum();
+#endif
 }
 
 
@@ -121,12 +148,21 @@ TTEntry* TranspositionTable::probe(const Key key, bool& found) const {
   const uint16_t key16 = (uint16_t)key;  // Use the low 16 bits as key inside the cluster
 
   for (int i = 0; i < ClusterSize; ++i)
-      if (tte[i].key16 == key16 || !tte[i].depth8)
+  {
+#if defined(USE_LOCKLESS_TT)
+      // The stored key matches but not once the checksum of the data is
+      // applied: without verification this entry would be a false hit.
+      if (tte[i].key16 == key16 && tte[i].key() != key16 && tte[i].depth8)
+          verifyFailures.fetch_add(1, std::memory_order_relaxed);
+#endif
+
+      if (tte[i].key() == key16 || !tte[i].depth8)
       {
           tte[i].genBound8 = uint8_t(generation8 | (tte[i].genBound8 & 0x7)); // Refresh
 
           return found = (bool)tte[i].depth8, &tte[i];
       }
+  }
 
   // Find an entry to be replaced according to the replacement strategy
   TTEntry* replace = tte;
@@ -155,3 +191,92 @@ int TranspositionTable::hashfull() const {
 
   return cnt / ClusterSize;
 }
+
+
+/// TranspositionTable::save() dumps the whole table to disk, preceded by a small
+/// header recording clusterCount, generation8 and the engine signature. Returns
+/// false if the file cannot be written.
+
+bool TranspositionTable::save(const std::string& fname) const {
+
+  Threads.main()->wait_for_search_finished();
+
+  std::ofstream file(fname, std::ios::binary);
+  const std::string sig = signature();
+  const uint64_t count = clusterCount;
+  const uint32_t sigSize = uint32_t(sig.size());
+
+  file.write(reinterpret_cast<const char*>(&SnapshotMagic), sizeof(SnapshotMagic));
+  file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+  file.write(reinterpret_cast<const char*>(&generation8), sizeof(generation8));
+  file.write(reinterpret_cast<const char*>(&sigSize), sizeof(sigSize));
+  file.write(sig.data(), sigSize);
+  file.write(reinterpret_cast<const char*>(table), std::streamsize(clusterCount * sizeof(Cluster)));
+
+  return bool(file);
+}
+
+
+/// TranspositionTable::load() restores a table previously written by save(). The
+/// file is rejected, leaving the current table untouched, if it was produced by
+/// a different engine or network, if its size does not match the current
+/// "Hash" setting, or if it is truncated. The table is read straight into the
+/// existing large-page allocation, so no extra copy of the snapshot is ever
+/// held in memory. Only a read error after these checks clears the table.
+
+bool TranspositionTable::load(const std::string& fname) {
+
+  Threads.main()->wait_for_search_finished();
+
+  std::ifstream file(fname, std::ios::binary);
+  uint32_t magic = 0, sigSize = 0;
+  uint64_t count = 0;
+  uint8_t gen = 0;
+
+  file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+  file.read(reinterpret_cast<char*>(&count), sizeof(count));
+  file.read(reinterpret_cast<char*>(&gen), sizeof(gen));
+  file.read(reinterpret_cast<char*>(&sigSize), sizeof(sigSize));
+
+  if (!file || magic != SnapshotMagic || sigSize > 4096)
+      return false;
+
+  std::string sig(sigSize, '\0');
+  file.read(&sig[0], sigSize);
+
+  if (!file || sig != signature())
+  {
+      sync_cout << "info string Hash snapshot " << fname
+                << " was saved by a different engine or network" << sync_endl;
+      return false;
+  }
+
+  if (count != clusterCount)
+  {
+      sync_cout << "info string Hash snapshot " << fname << " requires Hash "
+                << count * sizeof(Cluster) / (1024 * 1024) << sync_endl;
+      return false;
+  }
+
+  // Check that the whole table is there before overwriting any entry
+  const std::streampos start = file.tellg();
+  file.seekg(0, std::ios::end);
+
+  if (!file || uint64_t(file.tellg() - start) != clusterCount * sizeof(Cluster))
+  {
+      sync_cout << "info string Hash snapshot " << fname << " is truncated" << sync_endl;
+      return false;
+  }
+
+  file.seekg(start);
+  file.read(reinterpret_cast<char*>(table), std::streamsize(clusterCount * sizeof(Cluster)));
+
+  if (!file)
+  {
+      clear(); // Do not leave a partially read table behind
+      return false;
+  }
+
+  generation8 = gen;
+  return true;
+}
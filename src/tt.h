@@ -19,6 +19,9 @@
 #ifndef TT_H_INCLUDED
 #define TT_H_INCLUDED
 
+#include <atomic>
+#include <string>
+
 #include "misc.h"
 #include "types.h"
 
@@ -32,6 +35,11 @@
 /// move       16 bit
 /// value      16 bit
 /// eval value 16 bit
+///
+/// When compiled with USE_LOCKLESS_TT the key field does not hold the bare key
+/// but the key xored with a checksum of the other fields, so that an entry torn
+/// by concurrent non-atomic writes from different threads fails verification
+/// and is reported as a miss instead of as a false hit.
 
 struct TTEntry {
 
@@ -46,6 +54,17 @@ struct TTEntry {
 private:
   friend class TranspositionTable;
 
+#if defined(USE_LOCKLESS_TT)
+  // Generation bits are excluded because probe() refreshes them in place
+  uint16_t checksum() const {
+    return uint16_t(move16 ^ uint16_t(value16) ^ uint16_t(eval16) ^ (depth8 << 8) ^ (genBound8 & 0x7));
+  }
+#else
+  uint16_t checksum() const { return 0; }
+#endif
+
+  uint16_t key() const { return key16 ^ checksum(); }
+
   uint16_t key16;
   uint8_t  depth8;
   uint8_t  genBound8;
@@ -74,11 +93,14 @@ class TranspositionTable {
 
 public:
  ~TranspositionTable() { aligned_large_pages_free(table); }
-  void new_search() { generation8 += 8; } // Lower 3 bits are used by PV flag and Bound
+  void new_search() { generation8 += 8; verifyFailures = 0; } // Lower 3 bits are used by PV flag and Bound
   TTEntry* probe(const Key key, bool& found) const;
+  uint64_t verify_failures() const { return verifyFailures; }
   int hashfull() const;
   void resize(size_t mbSize);
   void clear();
+  bool save(const std::string& fname) const;
+  bool load(const std::string& fname);
 
   TTEntry* first_entry(const Key key) const {
     return &table[mul_hi64(key, clusterCount)].entry[0];
@@ -90,6 +112,7 @@ private:
   size_t clusterCount;
   Cluster* table;
   uint8_t generation8; // Size must be not bigger than TTEntry::genBound8
+  mutable std::atomic<uint64_t> verifyFailures; // Probes rejected by the checksum
 };
 
 extern TranspositionTable TT;
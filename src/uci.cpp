@@ -16,11 +16,17 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cmath>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
 
 #include "evaluate.h"
 #include "movegen.h"
@@ -91,6 +97,206 @@ namespace {
   }
 
 
+  // evalbatch() is called when engine receives the "evalbatch" command. It reads
+  // the positions in FEN format from the given file, one per line, evaluates
+  // them with NNUE in batches and prints each FEN followed by its evaluation in
+  // centipawns from White's point of view.
+
+  void evalbatch(istringstream& is) {
+
+    constexpr size_t ChunkSize = 1024;
+
+    string fname, fen;
+    getline(is >> ws, fname);
+    ifstream file(fname);
+
+    if (!file.is_open())
+    {
+        sync_cout << "info string Unable to open file " << fname << sync_endl;
+        return;
+    }
+
+    if (!Eval::useNNUE)
+    {
+        sync_cout << "info string evalbatch requires Use NNUE" << sync_endl;
+        return;
+    }
+
+    Eval::NNUE::verify();
+
+    vector<Position> positions(ChunkSize);
+    vector<StateInfo> states(ChunkSize);
+    vector<const Position*> batch;
+    vector<string> fens;
+    Value values[ChunkSize];
+
+    while (file)
+    {
+        batch.clear();
+        fens.clear();
+
+        while (fens.size() < ChunkSize && getline(file, fen))
+            if (!fen.empty())
+            {
+                Position& p = positions[fens.size()];
+                p.set(fen, Options["UCI_Chess960"], &states[fens.size()], Threads.main());
+                batch.push_back(&p);
+                fens.push_back(fen);
+            }
+
+        if (fens.empty())
+            break;
+
+        Eval::NNUE::evaluate_batch(batch.data(), batch.size(), values);
+
+        stringstream ss;
+        for (size_t i = 0; i < fens.size(); ++i)
+        {
+            Value v = batch[i]->side_to_move() == WHITE ? values[i] : -values[i];
+            ss << (i ? "\n" : "") << fens[i] << " : " << v * 100 / PawnValueEg;
+        }
+
+        sync_cout << ss.str() << sync_endl;
+    }
+  }
+
+
+  // tbrank() is called when engine receives the "tbrank" command. It reads the
+  // positions in FEN format from the given file, one per line, and ranks their
+  // moves with the tablebases using all the search threads, without starting a
+  // search. Each FEN is printed as soon as it is done, in no particular order,
+  // followed by its best move and distance to zeroing from the root, with the
+  // WDL value if only WDL tables are available, or by "none".
+
+  void tbrank(istringstream& is) {
+
+    string fname;
+    getline(is >> ws, fname);
+    ifstream file(fname);
+
+    if (!file.is_open())
+    {
+        sync_cout << "info string Unable to open file " << fname << sync_endl;
+        return;
+    }
+
+    Threads.main()->wait_for_search_finished();
+
+    bool chess960 = Options["UCI_Chess960"];
+    mutex fileMutex;
+    atomic<uint64_t> ranked(0);
+    vector<std::thread> workers;
+    TimePoint elapsed = now();
+
+    auto worker = [&](Thread* th) {
+
+        StateInfo st;
+        Position pos;
+        string fen;
+
+        while (true)
+        {
+            {
+                lock_guard<mutex> lk(fileMutex);
+
+                if (!getline(file, fen))
+                    return;
+            }
+
+            if (fen.empty())
+                continue;
+
+            pos.set(fen, chess960, &st, th);
+
+            Search::RootMoves rootMoves;
+            for (const auto& m : MoveList<LEGAL>(pos))
+                rootMoves.emplace_back(m);
+
+            bool dtz = false, wdl = false;
+
+            if (   !rootMoves.empty()
+                && popcount(pos.pieces()) <= Tablebases::MaxCardinality
+                && !pos.can_castle(ANY_CASTLING))
+                wdl = !(dtz = Tablebases::root_probe(pos, rootMoves))
+                      && Tablebases::root_probe_wdl(pos, rootMoves);
+
+            stringstream ss;
+            ss << fen << " : ";
+
+            if (dtz || wdl)
+            {
+                // Among the moves of the best rank prefer the fastest win or
+                // the slowest loss, that is the smallest signed DTZ.
+                auto best = min_element(rootMoves.begin(), rootMoves.end(),
+                                        [](const Search::RootMove& a, const Search::RootMove& b) {
+                    return a.tbRank != b.tbRank ? a.tbRank > b.tbRank : a.tbDTZ < b.tbDTZ;
+                });
+
+                ss << UCI::move(best->pv[0], chess960);
+
+                if (dtz)
+                    ss << " dtz " << best->tbDTZ;
+                else
+                    ss << " wdl " << (best->tbRank == 1000 ? 2 : best->tbRank > 0 ? 1 :
+                                      best->tbRank == 0 ? 0 : best->tbRank > -1000 ? -1 : -2);
+            }
+            else
+                ss << "none";
+
+            sync_cout << ss.str() << sync_endl;
+            ++ranked;
+        }
+    };
+
+    for (size_t i = 0; i < Threads.size(); ++i)
+        workers.emplace_back(worker, Threads[i]);
+
+    for (std::thread& w : workers)
+        w.join();
+
+    elapsed = now() - elapsed + 1; // Ensure positivity to avoid a 'divide by zero'
+
+    sync_cout << "info string Ranked " << ranked << " positions in " << elapsed << " ms, "
+              << 1000 * ranked / elapsed << " positions/s" << sync_endl;
+  }
+
+
+  // convertnet() is called when engine receives the "convertnet" command. It
+  // writes the network file <in> to <out> in the native layout of this build,
+  // which must be the given <arch>, so that <out> can be mapped when loaded.
+
+  void convertnet(istringstream& is) {
+
+    string in, out, arch;
+    is >> in >> out >> arch;
+
+    if (arch != Eval::NNUE::native_layout())
+    {
+        sync_cout << "info string This build can only write the "
+                  << Eval::NNUE::native_layout() << " layout" << sync_endl;
+        return;
+    }
+
+    ifstream inFile(in, ios::binary);
+    ofstream outFile;
+
+    if (inFile.is_open())
+        outFile.open(out, ios::binary);
+
+    if (!outFile.is_open())
+    {
+        sync_cout << "info string Unable to open file " << (inFile.is_open() ? out : in) << sync_endl;
+        return;
+    }
+
+    if (Eval::NNUE::convert_eval(inFile, outFile))
+        sync_cout << "info string Network " << in << " written to " << out
+                  << " in " << arch << " layout" << sync_endl;
+    else
+        sync_cout << "info string Failed to convert network " << in << sync_endl;
+  }
+
+
   // setoption() is called when engine receives the "setoption" UCI command. The
   // function updates the UCI option ("name") to the given value ("value").
 
@@ -149,16 +355,76 @@ namespace {
   }
 
 
+  // json_string() quotes and escapes a string for the JSON bench report
+
+  string json_string(const string& s) {
+
+    string r = "\"";
+    for (char c : s)
+        r += c == '"' ? "\\\"" : c == '\\' ? "\\\\" : c == '\n' ? "\\n" : string(1, c);
+    return r + "\"";
+  }
+
+
+  // BenchResult holds the outcome of the search of one bench position
+
+  struct BenchResult {
+    string fen, bestMove;
+    int depth, selDepth, hashfull;
+    uint64_t nodes;
+    TimePoint time;
+  };
+
+
+  // bench_json() prints the bench report as JSON, one entry per position
+
+  void bench_json(const vector<BenchResult>& results, uint64_t nodes, TimePoint elapsed) {
+
+    cerr << "{\n  \"engine\": " << json_string(engine_info())
+         << ",\n  \"compiler\": " << json_string(compiler_info())
+         << ",\n  \"threads\": " << Threads.size()
+         << ",\n  \"hash\": " << int(Options["Hash"])
+         << ",\n  \"positions\": [";
+
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const BenchResult& r = results[i];
+        cerr << (i ? "," : "")
+             << "\n    { \"fen\": " << json_string(r.fen)
+             << ", \"depth\": " << r.depth
+             << ", \"seldepth\": " << r.selDepth
+             << ", \"nodes\": " << r.nodes
+             << ", \"time\": " << r.time
+             << ", \"nps\": " << 1000 * r.nodes / r.time
+             << ", \"hashfull\": " << r.hashfull
+             << ", \"bestmove\": " << json_string(r.bestMove) << " }";
+    }
+
+    cerr << "\n  ],\n  \"total\": { \"time\": " << elapsed
+         << ", \"nodes\": " << nodes
+         << ", \"nps\": " << 1000 * nodes / elapsed << " }\n}" << endl;
+  }
+
+
   // bench() is called when engine receives the "bench" command. Firstly
   // a list of UCI commands is setup according to bench parameters, then
-  // it is run one by one printing a summary at the end.
+  // it is run one by one printing a summary at the end. With a trailing
+  // "json" argument, the summary is a JSON report with per-position results.
 
   void bench(Position& pos, istream& args, StateListPtr& states) {
 
     string token;
     uint64_t num, nodes = 0, cnt = 1;
+    Search::SearchStats stats;
+    vector<BenchResult> results;
+
+    string params;
+    getline(args, params);
+    size_t jsonPos = params.rfind(" json");
+    bool json = jsonPos != string::npos && params.find_first_not_of(' ', jsonPos + 5) == string::npos;
+    istringstream benchArgs(json ? params.substr(0, jsonPos) : params);
 
-    vector<string> list = setup_bench(pos, args);
+    vector<string> list = setup_bench(pos, benchArgs);
     num = count_if(list.begin(), list.end(), [](string s) { return s.find("go ") == 0 || s.find("eval") == 0; });
 
     TimePoint elapsed = now();
@@ -170,14 +436,39 @@ namespace {
 
         if (token == "go" || token == "eval")
         {
-            cerr << "\nPosition: " << cnt++ << '/' << num << " (" << pos.fen() << ")" << endl;
+            if (!json)
+                cerr << "\nPosition: " << cnt++ << '/' << num << " (" << pos.fen() << ")" << endl;
+
             if (token == "go")
             {
+               TimePoint start = now();
                go(pos, is, states);
                Threads.main()->wait_for_search_finished();
                nodes += Threads.nodes_searched();
+               stats += Threads.search_stats();
+
+               if (json)
+               {
+                   BenchResult r{ pos.fen(), "", Search::Limits.perft, 0, TT.hashfull(),
+                                  Threads.nodes_searched(), now() - start + 1 };
+
+                   // A perft has no best thread nor root moves to report
+                   if (!Search::Limits.perft)
+                   {
+                       Thread* best = Threads.get_best_thread();
+                       r.depth = best->completedDepth;
+
+                       if (!best->rootMoves.empty())
+                       {
+                           r.bestMove = UCI::move(best->rootMoves[0].pv[0], pos.is_chess960());
+                           r.selDepth = best->rootMoves[0].selDepth;
+                       }
+                   }
+
+                   results.push_back(r);
+               }
             }
-            else
+            else if (!json)
                trace_eval(pos);
         }
         else if (token == "setoption")  setoption(is);
@@ -189,10 +480,139 @@ namespace {
 
     dbg_print(); // Just before exiting
 
+    if (json)
+    {
+        bench_json(results, nodes, elapsed);
+        return;
+    }
+
     cerr << "\n==========================="
          << "\nTotal time (ms) : " << elapsed
          << "\nNodes searched  : " << nodes
          << "\nNodes/second    : " << 1000 * nodes / elapsed << endl;
+
+#if defined(USE_SEARCH_STATS)
+    cerr << stats
+         << "\nMoves/node        : " << double(stats.counters[Search::SearchStats::MovesGenerated])
+                                         / std::max(nodes, uint64_t(1)) << endl;
+#endif
+  }
+
+  // benchrun() is called when engine receives the "benchrun" command. It runs
+  // the bench workload, given by the usual bench arguments, a number of times
+  // and reports the mean, median, standard deviation and 95% confidence
+  // interval of the speed. With "pin" the engine threads are restricted to
+  // as many processors as search threads, e.g. "benchrun 10 pin 16 1 13".
+
+  void benchrun(Position& pos, istream& args, StateListPtr& states) {
+
+    // Two-sided 95% quantiles of Student's t distribution, by degrees of freedom
+    constexpr double T95[] = { 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306,
+                               2.262, 2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120,
+                               2.110, 2.101, 2.093, 2.086, 2.080, 2.074, 2.069, 2.064,
+                               2.060, 2.056, 2.052, 2.048, 2.045, 2.042 };
+    int runs = 0;
+    string token, params;
+
+    args >> runs;
+    runs = std::max(runs, 2);
+
+    getline(args, params);
+    bool pin = params.find(" pin") == 0;
+    istringstream benchArgs(pin ? params.substr(4) : params);
+
+    vector<string> list = setup_bench(pos, benchArgs);
+
+    if (pin)
+    {
+        size_t threads = stoi(list[0].substr(list[0].rfind(' ') + 1)); // Threads option
+        if (!pin_cpus(threads))
+            cerr << "Thread pinning is not supported on this system" << endl;
+    }
+
+    vector<double> nps;
+
+    for (int run = 1; run <= runs; ++run)
+    {
+        uint64_t nodes = 0;
+        TimePoint elapsed = now();
+
+        for (const auto& cmd : list)
+        {
+            istringstream is(cmd);
+            is >> skipws >> token;
+
+            if (token == "go")
+            {
+                go(pos, is, states);
+                Threads.main()->wait_for_search_finished();
+                nodes += Threads.nodes_searched();
+            }
+            else if (token == "setoption")  setoption(is);
+            else if (token == "position")   position(pos, is, states);
+            else if (token == "ucinewgame") { Search::clear(); elapsed = now(); }
+        }
+
+        elapsed = now() - elapsed + 1;
+        nps.push_back(1000.0 * nodes / elapsed);
+
+        cerr << "\nRun " << run << '/' << runs << ": " << nodes << " nodes "
+             << elapsed << " ms " << uint64_t(nps.back()) << " nps" << endl;
+    }
+
+    if (pin)
+    {
+        pin_cpus(0);
+        Threads.set(Threads.size()); // Recreate the threads with the restored affinity
+    }
+
+    double mean = 0, var = 0;
+
+    for (double v : nps)
+        mean += v / runs;
+
+    for (double v : nps)
+        var += (v - mean) * (v - mean) / (runs - 1);
+
+    sort(nps.begin(), nps.end());
+
+    double median = (nps[(runs - 1) / 2] + nps[runs / 2]) / 2;
+    double sd = std::sqrt(var);
+    double ci = (runs - 1 <= 30 ? T95[runs - 2] : 1.96) * sd / std::sqrt(runs);
+
+    cerr << "\n==========================="
+         << "\nRuns            : " << runs
+         << "\nNodes/second    : " << uint64_t(mean) << " mean, " << uint64_t(median) << " median"
+         << "\nStd deviation   : " << uint64_t(sd) << " (" << fixed << setprecision(2) << 100 * sd / mean << "%)"
+         << "\n95% confidence  : " << uint64_t(mean - ci) << " - " << uint64_t(mean + ci)
+         << " (+/- " << 100 * ci / mean << "%)" << defaultfloat << endl;
+  }
+
+
+  // savehash() and loadhash() are called when engine receives the "savehash" or
+  // "loadhash" command. They dump or restore the transposition table to/from the
+  // file whose name (which can contain spaces) is given as argument.
+
+  void savehash(istringstream& is) {
+
+    string fname;
+    getline(is >> ws, fname);
+
+    if (TT.save(fname))
+        sync_cout << "info string Hash saved to " << fname << sync_endl;
+    else
+        sync_cout << "info string Failed to save hash to " << fname << sync_endl;
+  }
+
+  void loadhash(istringstream& is) {
+
+    string fname;
+    getline(is >> ws, fname);
+
+    if (TT.load(fname))
+        sync_cout << "info string Hash loaded from " << fname << sync_endl;
+    else
+        sync_cout << "info string Failed to load hash from " << fname << sync_endl;
   }
 
   // The win rate model returns the probability (per mille) of winning given an eval
@@ -272,9 +692,20 @@ void UCI::loop(int argc, char* argv[]) {
       // Do not use these commands during a search!
       else if (token == "flip")     pos.flip();
       else if (token == "bench")    bench(pos, is, states);
+      else if (token == "benchrun") benchrun(pos, is, states);
       else if (token == "d")        sync_cout << pos << sync_endl;
       else if (token == "eval")     trace_eval(pos);
+      else if (token == "evalbatch") evalbatch(is);
+      else if (token == "tbrank")   tbrank(is);
+      else if (token == "convertnet") convertnet(is);
       else if (token == "compiler") sync_cout << compiler_info() << sync_endl;
+      else if (token == "ttstats")  sync_cout << "TT false hits: " << Threads.tt_collisions()
+                                          << " in " << Threads.nodes_searched() << " nodes"
+                                          << "\nTT verification failures: " << TT.verify_failures() << sync_endl;
+      else if (token == "tbwarm")   { size_t mb = Options["SyzygyPreload"]; is >> mb; Tablebases::warm(mb); }
+      else if (token == "stats")    sync_cout << Threads.search_stats() << sync_endl;
+      else if (token == "savehash") savehash(is);
+      else if (token == "loadhash") loadhash(is);
       else
           sync_cout << "Unknown command: " << cmd << sync_endl;
 
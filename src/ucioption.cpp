@@ -23,6 +23,7 @@
 
 #include "evaluate.h"
 #include "misc.h"
+#include "pawns.h"
 #include "search.h"
 #include "thread.h"
 #include "tt.h"
@@ -41,8 +42,13 @@ void on_hash_size(const Option& o) { TT.resize(size_t(o)); }
 void on_logger(const Option& o) { start_logger(o); }
 void on_threads(const Option& o) { Threads.set(size_t(o)); }
 void on_tb_path(const Option& o) { Tablebases::init(o); }
+void on_tb_index(const Option& ) { Tablebases::init(Options["SyzygyPath"]); }
+void on_tb_preload(const Option& o) { if (int(o)) Tablebases::warm(size_t(o)); }
 void on_use_NNUE(const Option& ) { Eval::NNUE::init(); }
 void on_eval_file(const Option& ) { Eval::NNUE::init(); }
+void on_replicate_NNUE(const Option& ) { Eval::NNUE::replicate(); }
+void on_eval_hash(const Option& ) { Threads.resize_eval_tables(); }
+void on_shared_pawn_hash(const Option& o) { Pawns::resize_shared(size_t(o)); }
 
 /// Our case insensitive less() function as required by UCI protocol
 bool CaseInsensitiveLess::operator() (const string& s1, const string& s2) const {
@@ -64,6 +70,9 @@ void init(OptionsMap& o) {
   o["Threads"]               << Option(1, 1, 512, on_threads);
   o["Hash"]                  << Option(16, 1, MaxHashMB, on_hash_size);
   o["Clear Hash"]            << Option(on_clear_hash);
+  o["Pawn Hash"]             << Option(12288, 64, 1048576, on_eval_hash);
+  o["Material Hash"]         << Option(320, 64, 1048576, on_eval_hash);
+  o["Shared Pawn Hash"]      << Option(0, 0, 4096, on_shared_pawn_hash);
   o["Ponder"]                << Option(false);
   o["MultiPV"]               << Option(1, 1, 500);
   o["Skill Level"]           << Option(20, 0, 20);
@@ -79,8 +88,11 @@ void init(OptionsMap& o) {
   o["SyzygyProbeDepth"]      << Option(1, 1, 100);
   o["Syzygy50MoveRule"]      << Option(true);
   o["SyzygyProbeLimit"]      << Option(7, 0, 7);
+  o["SyzygyPreload"]         << Option(0, 0, 16777216, on_tb_preload);
+  o["SyzygyIndexFile"]       << Option("<empty>", on_tb_index);
   o["Use NNUE"]              << Option(true, on_use_NNUE);
   o["EvalFile"]              << Option(EvalFileDefaultName, on_eval_file);
+  o["Replicate NNUE"]        << Option(false, on_replicate_NNUE);
 }
 
 